@@ -0,0 +1,127 @@
+#include <minivim.h>
+#include <time.h>
+
+/* editor_conf global var (main.c is not linked in benchmarks) */
+struct editor_conf g_e;
+
+/* get time in seconds */
+static double bench_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* append the corpus files to fp */
+static void bench_gen(const char *path, int n_files, char *files[]) {
+	FILE *fp = fopen(path, "w");
+	char buff[1 << 16];
+
+	if (!fp) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < n_files; i++) {
+		FILE *src = fopen(files[i], "r");
+		size_t len;
+		if (!src) {
+			perror(files[i]);
+			exit(EXIT_FAILURE);
+		}
+		while ((len = fread(buff, 1, sizeof(buff), src)) > 0)
+			fwrite(buff, 1, len, fp);
+		fclose(src);
+	}
+
+	fclose(fp);
+}
+
+/* frame kinds: everything drawn again, scroll one row down, type a char */
+static void bench_full(int i) {
+	(void)i;
+	editor_invalidate_screen();
+}
+
+static void bench_scroll(int i) {
+	g_e.cy = (g_e.scrn_rows + i) % g_e.n_rows;
+	g_e.cx = 0;
+}
+
+static void bench_type(int i) {
+	/* next row every 64 chars (rows do not get too long) */
+	g_e.cy = (i / 64) % g_e.scrn_rows;
+	g_e.cx = i % 64;
+	editor_insert_char('a' + i % 26);
+}
+
+/* draw n frames (output goes to /dev/null), report time, bytes (and bytes/s) and buffer reallocs per frame */
+static void bench_frames(const char *name, int n, void (*step)(int)) {
+	int null_fd = open("/dev/null", O_WRONLY);
+	int out_fd = dup(STDOUT_FILENO);
+	size_t n_grow = g_e.frame.n_grow;
+	size_t bytes = 0;
+	double st;
+	double t;
+
+	/* same start for every kind */
+	g_e.cx = 0;
+	g_e.cy = 0;
+	g_e.y_off = 0;
+	g_e.x_off = 0;
+	editor_invalidate_screen();
+
+	dup2(null_fd, STDOUT_FILENO);
+	st = bench_now();
+	for (int i = 0; i < n; i++) {
+		step(i);
+		editor_refresh_screen();
+		bytes += g_e.frame.len;
+	}
+	t = bench_now() - st;
+	dup2(out_fd, STDOUT_FILENO);
+	close(out_fd);
+	close(null_fd);
+
+	printf("bench-draw: %-6s %dx%d %7d frames %9.1f us/frame %9.1f B/frame %7.1f MB/s %8.4f allocs/frame\n",
+		name, g_e.scrn_cols, g_e.scrn_rows + 2, n, t / n * 1e6, bytes / (double)n,
+		bytes / (double)(1 << 20) / t, (g_e.frame.n_grow - n_grow) / (double)n);
+}
+
+/* main */
+int main(int argc, char *argv[]) {
+	const char *path = "/tmp/minivim_bench_draw.c";
+	int n;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s [FRAMES] [C FILES...]\n", argv[0]);
+		return (EXIT_FAILURE);
+	}
+	n = atoi(argv[1]);
+
+	/* initialise editor (no terminal needed, big screen) */
+	g_e.scrn_rows = 60 - 2;
+	g_e.scrn_cols = 200;
+	g_e.rc_max = (size_t)-1;
+	g_e.hl_gen = 1;
+	g_e.hl_fd = -1;
+	g_e.map_fd = -1;
+	g_e.mode = NORMAL_MODE;
+	g_e.out_fd = STDOUT_FILENO;
+
+	/* open corpus */
+	bench_gen(path, argc - 2, &argv[2]);
+	editor_open(path);
+
+	bench_frames("full", n, bench_full);
+	bench_frames("scroll", n, bench_scroll);
+	bench_frames("type", n, bench_type);
+
+	/* close buffer and remove file */
+	rtree_free();
+	editor_unmap();
+	unlink(path);
+	apbuff_free(&g_e.frame);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,124 @@
+#include <minivim.h>
+#include <time.h>
+
+/* a key can not take longer on a long line than this many times what it takes on the shortest one */
+# define EDIT_MAX_RATIO 4
+
+/* editor_conf global var (main.c is not linked in benchmarks) */
+struct editor_conf g_e;
+
+/* time per key (insert and delete) on the shortest line, editing only the line and rendering the row */
+static double edit_base[2];
+static int edit_fail = 0;
+
+/* get time in seconds */
+static double bench_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* code the lines are made of */
+static const char *bench_code = "int x = 42; /* c */ s = \"str\";\t";
+
+/* write a C file with a single line of len bytes */
+static void bench_gen(const char *path, size_t len) {
+	const char *code = bench_code;
+	size_t code_l = strlen(code);
+	FILE *fp = fopen(path, "w");
+
+	if (!fp) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < len; i++)
+		fputc(code[i % code_l], fp);
+	fputc('\n', fp);
+
+	fclose(fp);
+}
+
+/* type n chars at the cursor and delete them, return time per key (insert, delete) */
+static void bench_keys(int n, int render, double *t_ins, double *t_del) {
+	double st;
+	int i;
+
+	st = bench_now();
+	for (i = 0; i < n; i++) {
+		editor_insert_char('a' + i % 26);
+		if (render)
+			editor_row_render(editor_row_at(g_e.cy));
+	}
+	*t_ins = (bench_now() - st) / n;
+
+	st = bench_now();
+	for (i = 0; i < n; i++) {
+		editor_del_char();
+		if (render)
+			editor_row_render(editor_row_at(g_e.cy));
+	}
+	*t_del = (bench_now() - st) / n;
+}
+
+/* type in the middle of a line of len bytes, only the line and rendering the row after every key (as the screen does), check it does not take longer than on the shortest line */
+static void bench_edit(const char *path, size_t len, int n) {
+	double line[2];
+	double rend[2];
+
+	bench_gen(path, len);
+	editor_open(path);
+	g_e.cy = 0;
+	/* at the start of the code in the middle of the line (the same place on every line) */
+	g_e.cx = len / 2 - len / 2 % strlen(bench_code);
+	editor_row_render(editor_row_at(0));
+
+	/* the first key moves the gaps of the row to the cursor (like moving the cursor there) */
+	editor_insert_char('a');
+	editor_del_char();
+
+	bench_keys(n, 0, &line[0], &line[1]);
+	bench_keys(n, 1, &rend[0], &rend[1]);
+
+	printf("bench-edit: %9zu B line %7d keys   line: %8.2f us/insert %8.2f us/delete   render: %9.2f us/insert %9.2f us/delete\n",
+		len, n, line[0] * 1e6, line[1] * 1e6, rend[0] * 1e6, rend[1] * 1e6);
+
+	if (!edit_base[0]) {
+		edit_base[0] = line[0] + line[1];
+		edit_base[1] = rend[0] + rend[1];
+	} else if (line[0] + line[1] > edit_base[0] * EDIT_MAX_RATIO || rend[0] + rend[1] > edit_base[1] * EDIT_MAX_RATIO) {
+		printf("bench-edit: FAIL: a key takes %.1fx (line) and %.1fx (render) what it takes on the shortest line (max %dx)\n",
+			(line[0] + line[1]) / edit_base[0], (rend[0] + rend[1]) / edit_base[1], EDIT_MAX_RATIO);
+		edit_fail = 1;
+	}
+
+	/* close buffer and remove file */
+	rtree_free();
+	editor_unmap();
+	unlink(path);
+}
+
+/* main */
+int main(int argc, char *argv[]) {
+	const char *path = "/tmp/minivim_bench_edit.c";
+	int n = (argc >= 2) ? atoi(argv[1]) : 2000;
+
+	/* initialise editor (no terminal needed) */
+	g_e.scrn_rows = 24;
+	g_e.scrn_cols = 80;
+	g_e.rc_max = RCACHE_MAX;
+	g_e.hl_gen = 1;
+	g_e.hl_fd = -1;
+	g_e.map_fd = -1;
+	g_e.mode = INSERT_MODE;
+
+	bench_edit(path, 80, n);
+	bench_edit(path, 10 << 10, n);
+	bench_edit(path, 100 << 10, n);
+	bench_edit(path, 1 << 20, n);
+
+	printf("bench-edit: %s\n", edit_fail ? "FAIL" : "ok");
+
+	return (edit_fail ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,92 @@
+#include <minivim.h>
+#include <time.h>
+
+/* editor_conf global var (main.c is not linked in benchmarks) */
+struct editor_conf g_e;
+
+/* get time in seconds */
+static double bench_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* append the corpus files to fp until it has about mb megabytes */
+static void bench_gen(const char *path, size_t mb, int n_files, char *files[]) {
+	FILE *fp = fopen(path, "w");
+	size_t t_len = 0;
+	char buff[1 << 16];
+
+	if (!fp) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	while (t_len < mb << 20) {
+		for (int i = 0; i < n_files; i++) {
+			FILE *src = fopen(files[i], "r");
+			size_t len;
+			if (!src) {
+				perror(files[i]);
+				exit(EXIT_FAILURE);
+			}
+			while ((len = fread(buff, 1, sizeof(buff), src)) > 0) {
+				fwrite(buff, 1, len, fp);
+				t_len += len;
+			}
+			fclose(src);
+		}
+	}
+
+	fclose(fp);
+}
+
+/* main */
+int main(int argc, char *argv[]) {
+	const char *path = "/tmp/minivim_bench_hl.c";
+	size_t mb;
+	size_t t_len = 0;
+	double st;
+	double t;
+	e_row *row;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s [MB] [C FILES...]\n", argv[0]);
+		return (EXIT_FAILURE);
+	}
+	mb = atoi(argv[1]);
+
+	/* initialise editor (no terminal needed) */
+	g_e.scrn_rows = 24;
+	g_e.scrn_cols = 80;
+	g_e.rc_max = (size_t)-1;
+	g_e.hl_gen = 1;
+	g_e.map_fd = -1;
+
+	/* open corpus and build the render of every row */
+	bench_gen(path, mb, argc - 2, &argv[2]);
+	editor_open(path);
+	for (row = editor_row_at(0); row; row = editor_row_next(row)) {
+		editor_row_render(row);
+		t_len += row->rc->r_sz + 1;
+	}
+
+	/* hl all the rows again (new syntax generation) */
+	g_e.hl_gen++;
+	g_e.hl_upto = 0;
+	st = bench_now();
+	for (row = editor_row_at(0); row; row = editor_row_next(row))
+		editor_update_syntax(row);
+	t = bench_now() - st;
+
+	printf("bench-hl: %-28s %6.1f MB %9ld rows %8.3f s %9.1f MB/s\n",
+		path, t_len / (double)(1 << 20), g_e.n_rows, t, t_len / (double)(1 << 20) / t);
+
+	/* close buffer and remove file */
+	rtree_free();
+	editor_unmap();
+	unlink(path);
+
+	return (EXIT_SUCCESS);
+}
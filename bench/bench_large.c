@@ -0,0 +1,304 @@
+#include <minivim.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/* editor_conf global var (main.c is not linked in benchmarks) */
+struct editor_conf g_e;
+
+/* bytes of every line of the file with many rows */
+# define LARGE_STEP (64 << 10)
+
+/* text searched for (and where it is from the start of its row) */
+# define LARGE_NEEDLE "needle"
+# define LARGE_NEEDLE_X 100
+
+/* set when a check fails */
+static int large_fail = 0;
+
+/* get time in seconds */
+static double bench_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* get cpu time used by the process (user and kernel) in seconds */
+static double bench_cpu() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* report a check that failed */
+static void large_check(const char *name, int ok, const char *format, ...) {
+	va_list args;
+
+	if (ok)
+		return;
+
+	printf("bench-large: %s: FAIL: ", name);
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+	large_fail = 1;
+}
+
+/* write len bytes at off (the rest of the file is a hole) */
+static void large_put(int fd, const char *s, size_t len, off_t off) {
+	if (pwrite(fd, s, len, off) != (ssize_t)len) {
+		perror("pwrite");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* create a sparse file of sz bytes, rows ends every step bytes (0: only at the end) and the needle is at off */
+static void large_gen(const char *path, off_t sz, off_t step, off_t off) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd == -1 || ftruncate(fd, sz) == -1) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	for (off_t nl = step ? step - 1 : sz - 1; nl < sz; nl += step ? step : sz)
+		large_put(fd, "\n", 1, nl);
+	large_put(fd, LARGE_NEEDLE, strlen(LARGE_NEEDLE), off);
+
+	close(fd);
+}
+
+/* compare len bytes of file a at off_a with file b at off_b */
+static int large_cmp(int fd_a, off_t off_a, int fd_b, off_t off_b, off_t len) {
+	static char a[1 << 20];
+	static char b[1 << 20];
+
+	while (len > 0) {
+		size_t n = (len < (off_t)sizeof(a)) ? (size_t)len : sizeof(a);
+		if (pread(fd_a, a, n, off_a) != (ssize_t)n || pread(fd_b, b, n, off_b) != (ssize_t)n)
+			return (-1);
+		if (memcmp(a, b, n))
+			return (-1);
+		off_a += n;
+		off_b += n;
+		len -= n;
+	}
+
+	return (0);
+}
+
+/* check that the saved file is the original with ins inserted at off (nothing if ins is NULL) */
+static int large_saved(const char *path, const char *saved, off_t off, const char *ins) {
+	size_t ins_l = ins ? strlen(ins) : 0;
+	int fd = open(path, O_RDONLY);
+	int fd_s = open(saved, O_RDONLY);
+	struct stat st;
+	struct stat st_s;
+	char buff[16];
+	int ret = -1;
+
+	if (fd != -1 && fd_s != -1 && fstat(fd, &st) != -1 && fstat(fd_s, &st_s) != -1
+		&& st_s.st_size == st.st_size + (off_t)ins_l
+		&& large_cmp(fd, 0, fd_s, 0, off) == 0
+		&& pread(fd_s, buff, ins_l, off) == (ssize_t)ins_l && !memcmp(buff, ins, ins_l)
+		&& large_cmp(fd, off, fd_s, off + ins_l, st.st_size - off) == 0)
+		ret = 0;
+
+	if (fd != -1)
+		close(fd);
+	if (fd_s != -1)
+		close(fd_s);
+
+	return (ret);
+}
+
+/* get the data memory of the process in bytes (heap and private mappings that can be written, not the file mapping) */
+static size_t large_data() {
+	FILE *fp = fopen("/proc/self/status", "r");
+	char line[128];
+	size_t kb = 0;
+
+	while (fp && fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "VmData: %zu kB", &kb) == 1)
+			break;
+	}
+	if (fp)
+		fclose(fp);
+
+	return (kb << 10);
+}
+
+/* save the buffer as another file (the data memory can only grow mem_mb, saving does not copy the file) */
+static void large_save_as(const char *saved, size_t mem_mb) {
+	struct rlimit rl;
+
+	free(g_e.filename);
+	g_e.filename = strdup(saved);
+
+	getrlimit(RLIMIT_DATA, &rl);
+	rlim_t cur = rl.rlim_cur;
+	rl.rlim_cur = large_data() + (mem_mb << 20);
+	setrlimit(RLIMIT_DATA, &rl);
+	editor_save();
+	rl.rlim_cur = cur;
+	setrlimit(RLIMIT_DATA, &rl);
+}
+
+/* check the memory used by the rows is under the budget */
+static size_t large_mem(const char *name, size_t mem_mb) {
+	struct rmem_stats mem;
+
+	rmem_get_stats(&mem);
+	large_check(name, mem.used <= mem_mb << 20, "rows use %zu MB (budget %zu MB)", mem.used >> 20, mem_mb);
+
+	return (mem.used >> 20);
+}
+
+/* close the buffer and remove the files */
+static void large_close(const char *path, const char *saved) {
+	rtree_free();
+	editor_unmap();
+	unlink(path);
+	unlink(saved);
+	g_e.cx = 0;
+	g_e.cy = 0;
+	g_e.y_off = 0;
+	g_e.x_off = 0;
+	g_e.dirty = 0;
+}
+
+/* many rows of LARGE_STEP bytes, the last ones are past 2 GB: open, go to the end, search, edit one and save */
+static void large_rows(const char *path, const char *saved, off_t sz, size_t mem_mb) {
+	long n = sz / LARGE_STEP;
+	long needle = n - 2;
+	off_t off = (off_t)needle * LARGE_STEP + LARGE_NEEDLE_X;
+	double t[5];
+	double st;
+	double cpu;
+	long cx;
+	e_row *row;
+
+	large_gen(path, sz, LARGE_STEP, off);
+
+	/* open */
+	st = bench_now();
+	editor_open(path);
+	t[0] = bench_now() - st;
+	large_check("rows", g_e.n_rows == n, "%ld rows (expected %ld)", g_e.n_rows, n);
+	off_t t_len = 0;
+	for (row = editor_row_at(0); row; row = editor_row_next(row))
+		t_len += row->sz + 1;
+	large_check("rows", t_len == sz, "rows have %lld bytes (expected %lld)", (long long)t_len, (long long)sz);
+
+	/* go to the last row and draw it */
+	st = bench_now();
+	g_e.cy = n - 1;
+	editor_move_cursor(K_ARROW_UP);
+	editor_move_cursor(K_ARROW_DOWN);
+	editor_refresh_screen();
+	t[1] = bench_now() - st;
+	large_check("rows", g_e.cy == n - 1 && g_e.y_off == n - g_e.scrn_rows, "cursor at row %ld (offset %ld)", g_e.cy, g_e.y_off);
+
+	/* search forward and backward */
+	st = bench_now();
+	long cur = editor_find_next(LARGE_NEEDLE, -1, 1, &cx);
+	large_check("rows", cur == needle && cx == LARGE_NEEDLE_X, "match at %ld, %ld (expected %ld, %d)", cur, cx, needle, LARGE_NEEDLE_X);
+	cur = editor_find_next(LARGE_NEEDLE, 0, -1, &cx);
+	large_check("rows", cur == needle && cx == LARGE_NEEDLE_X, "match back at %ld, %ld (expected %ld, %d)", cur, cx, needle, LARGE_NEEDLE_X);
+	t[2] = bench_now() - st;
+
+	/* type a char before the match and save as another file */
+	g_e.cy = needle;
+	g_e.cx = LARGE_NEEDLE_X;
+	editor_insert_char('X');
+	editor_refresh_screen();
+	st = bench_now();
+	cpu = bench_cpu();
+	large_save_as(saved, mem_mb);
+	t[3] = bench_now() - st;
+	t[4] = bench_cpu() - cpu;
+	large_check("rows", g_e.dirty == 0, "not saved: %s", g_e.status_msg);
+	large_check("rows", large_saved(path, saved, off, "X") == 0, "saved file is not the original with the char typed");
+
+	printf("bench-large: rows %7.2f GB %9ld rows %8.3f s open %8.3f s end %8.3f s search %8.3f s save (%.3f s cpu) %6zu MB used\n",
+		sz / (double)(1 << 30), n, t[0], t[1], t[2], t[3], t[4], large_mem("rows", mem_mb));
+
+	large_close(path, saved);
+}
+
+/* one row of the whole size (past 2 GB): open, go to the end of it, search and save */
+static void large_line(const char *path, const char *saved, off_t sz, size_t mem_mb) {
+	off_t off = sz - 1000;
+	double t[5];
+	double st;
+	double cpu;
+	long cx;
+
+	large_gen(path, sz, 0, off);
+
+	/* open */
+	st = bench_now();
+	editor_open(path);
+	t[0] = bench_now() - st;
+	e_row *row = editor_row_at(0);
+	large_check("line", g_e.n_rows == 1 && row->sz == sz - 1, "%ld rows, %ld bytes (expected 1, %lld)",
+		g_e.n_rows, row ? row->sz : 0, (long long)sz - 1);
+
+	/* go to the end of the row and draw it */
+	st = bench_now();
+	g_e.cx = row->sz;
+	editor_move_cursor(K_ARROW_LEFT);
+	editor_move_cursor(K_ARROW_RIGHT);
+	editor_refresh_screen();
+	t[1] = bench_now() - st;
+	large_check("line", g_e.cx == sz - 2 && g_e.rx == g_e.cx && g_e.x_off == g_e.rx - g_e.scrn_cols + 1,
+		"cursor at %ld, render %ld (offset %ld)", g_e.cx, g_e.rx, g_e.x_off);
+	large_check("line", editor_row_rx_to_cx(row, g_e.rx) == g_e.cx, "render %ld is at %ld", g_e.rx, editor_row_rx_to_cx(row, g_e.rx));
+
+	/* search */
+	st = bench_now();
+	long cur = editor_find_next(LARGE_NEEDLE, -1, 1, &cx);
+	t[2] = bench_now() - st;
+	large_check("line", cur == 0 && cx == off, "match at %ld, %ld (expected 0, %lld)", cur, cx, (long long)off);
+
+	/* save as another file */
+	st = bench_now();
+	cpu = bench_cpu();
+	large_save_as(saved, mem_mb);
+	t[3] = bench_now() - st;
+	t[4] = bench_cpu() - cpu;
+	large_check("line", g_e.dirty == 0, "not saved: %s", g_e.status_msg);
+	large_check("line", large_saved(path, saved, sz, NULL) == 0, "saved file is not the original");
+
+	printf("bench-large: line %7.2f GB %9ld rows %8.3f s open %8.3f s end %8.3f s search %8.3f s save (%.3f s cpu) %6zu MB used\n",
+		sz / (double)(1 << 30), g_e.n_rows, t[0], t[1], t[2], t[3], t[4], large_mem("line", mem_mb));
+
+	large_close(path, saved);
+}
+
+/* main */
+int main(int argc, char *argv[]) {
+	double gb = (argc >= 2) ? atof(argv[1]) : 3;
+	size_t mem_mb = (argc >= 3) ? (size_t)atoi(argv[2]) : 512;
+	off_t sz = (off_t)(gb * (1 << 30)) / LARGE_STEP * LARGE_STEP;
+
+	/* initialise editor (no terminal needed, frames go to /dev/null) */
+	g_e.scrn_rows = 24;
+	g_e.scrn_cols = 80;
+	g_e.rc_max = RCACHE_MAX;
+	g_e.hl_gen = 1;
+	g_e.hl_fd = -1;
+	g_e.map_fd = -1;
+	g_e.mode = NORMAL_MODE;
+	g_e.out_fd = open("/dev/null", O_WRONLY);
+
+	large_rows("/tmp/minivim_bench_large.log", "/tmp/minivim_bench_large_saved.log", sz, mem_mb);
+	large_line("/tmp/minivim_bench_large.txt", "/tmp/minivim_bench_large_saved.txt", sz, mem_mb);
+	apbuff_free(&g_e.frame);
+
+	printf("bench-large: %s\n", large_fail ? "FAIL" : "ok");
+
+	return (large_fail ? EXIT_FAILURE : EXIT_SUCCESS);
+}
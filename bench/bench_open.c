@@ -0,0 +1,85 @@
+#include <minivim.h>
+#include <time.h>
+
+/* editor_conf global var (main.c is not linked in benchmarks) */
+struct editor_conf g_e;
+
+/* get time in seconds */
+static double bench_now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* generate a file of about mb megabytes, with log lines or c code */
+static void bench_gen(const char *path, size_t mb, int code) {
+	FILE *fp = fopen(path, "w");
+	size_t t_len = 0;
+	unsigned int i = 0;
+
+	if (!fp) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	/* write lines until the size is reached */
+	while (t_len < mb << 20) {
+		int len;
+		if (code) {
+			len = fprintf(fp, "%sint func_%u(char *s, int n) { /* %u */ return (n + %u); }\n",
+				(i % 4) ? "\t" : "", i, i * 7, i % 1000);
+		} else {
+			len = fprintf(fp, "2022-01-%02u 12:%02u:%02u [INFO] worker %u: processed request id=%u in %u ms\n",
+				i % 28 + 1, i % 60, (i / 60) % 60, i % 16, i, i % 997);
+		}
+		t_len += len;
+		i++;
+	}
+
+	fclose(fp);
+}
+
+/* open a generated file and report the throughput */
+static void bench_open(const char *path, size_t mb, int code) {
+	double st;
+	double t;
+
+	bench_gen(path, mb, code);
+
+	st = bench_now();
+	editor_open(path);
+	t = bench_now() - st;
+
+	printf("bench-open: %-28s %6zu MB %9ld rows %8.3f s %9.1f MB/s\n",
+		path, mb, g_e.n_rows, t, mb / t);
+
+	/* memory used by the rows */
+	struct rmem_stats mem;
+	rmem_get_stats(&mem);
+	printf("bench-open: %-28s %6zu MB used %6zu slabs %6zu big %3d%% unused",
+		"", mem.used >> 20, mem.n_slabs, mem.n_big, rmem_frag(&mem));
+
+	/* close buffer (all the rows at once) and remove file */
+	st = bench_now();
+	rtree_free();
+	printf(" %8.3f ms close\n", (bench_now() - st) * 1e3);
+	editor_unmap();
+	unlink(path);
+}
+
+/* main */
+int main(int argc, char *argv[]) {
+	size_t mb = (argc >= 2) ? (size_t)atoi(argv[1]) : 64;
+
+	/* initialise editor (no terminal needed) */
+	g_e.scrn_rows = 24;
+	g_e.scrn_cols = 80;
+	g_e.rc_max = RCACHE_MAX;
+	g_e.map_fd = -1;
+
+	bench_open("/tmp/minivim_bench_open.log", mb, 0);
+	bench_open("/tmp/minivim_bench_open.c", mb, 1);
+
+	return (EXIT_SUCCESS);
+}
@@ -10,15 +10,30 @@
 /*** includes ***/
 
 # include <ctype.h>
+# include <dirent.h>
 # include <errno.h>
 # include <fcntl.h>
+# include <limits.h>
+# include <poll.h>
+# include <pthread.h>
+# include <signal.h>
+# include <stdint.h>
 # include <stdlib.h>
 # include <string.h>
 # include <stdio.h>
 # include <stdarg.h>
+# include <stddef.h>
 # include <sys/ioctl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
 # include <sys/types.h>
+# include <sys/uio.h>
+# ifdef __linux__
+#  include <sys/eventfd.h>
+#  include <sys/xattr.h>
+# endif
 # include <termios.h>
+# include <time.h>
 # include <unistd.h>
 
 /*** defines ***/
@@ -33,19 +48,101 @@
 #  define CURSOR_HL 1
 # endif
 
+/* default memory budget for render and hl of the rows */
+# ifndef RCACHE_MAX
+#  define RCACHE_MAX (64 << 20)
+# endif
+
+/* size of the slabs rows are allocated from */
+# ifndef RMEM_SLAB
+#  define RMEM_SLAB (64 << 10)
+# endif
+
+# ifndef MMAP_OPEN
+#  define MMAP_OPEN 1
+# endif
+
+/* wrap frames in synchronized updates (mode 2026) */
+# ifndef SYNC_UPDATE
+#  define SYNC_UPDATE 1
+# endif
+
 # define CTRL_KEY(k) ((k) & 0x1f)
-# define APBUFF_INIT {NULL, 0}
+# define APBUFF_INIT {NULL, 0, 0, 0}
 
 # define NORMAL_MODE 0
 # define INSERT_MODE 1
 
-# define C_HL_EXT_SIZE 6
-# define C_HL_KEYW_SIZE 82
-# define HLDB_SIZE 1
+# define RT_CAP 64
+/* (the slot of a row in a leaf is 8 bits) */
+/* rows per leaf when bulk loading (leave room for inserts) */
+# define RT_FILL (RT_CAP - RT_CAP / 4)
+# define RT_BUILDER_INIT {NULL, NULL, 0}
+
+/* min and max free space of the gap of a row being edited (it grows with the line) */
+# define GAP_MIN 64
+# define GAP_MAX (1 << 30)
+
+/* bytes between the render column checkpoints of a row (rows shorter than 2 steps have none) */
+# define COL_STEP 256
+
+/* char i of the line of a row (skips the gap of the row being edited) */
+# define ROW_CH(row, i) ((row)->line[((i) < (row)->gap) ? (i) : (i) + (row)->gap_l])
+
+/* char i of the render of a row, span i of its hl and the start of it (skip the gaps, see struct row_rend) */
+# define REND_CH(rc, i) ((rc)->rend[((i) < (rc)->r_gap) ? (i) : (i) + (rc)->r_gap_l])
+# define HL_SPAN(rc, i) ((rc)->hl[((i) < (rc)->hl_gap) ? (i) : (i) + (rc)->hl_gap_l])
+# define HL_ST(rc, i) (((i) < (rc)->hl_gap) ? (rc)->hl[i].st : (rc)->hl[(i) + (rc)->hl_gap_l].st + (rc)->r_sz)
+
+/* bytes allocated for the line of a row (with the gap and the '\0') and for n hl spans (room for one at least) */
+# define ROW_LINE_SZ(row) ((row)->sz + (row)->gap_l + 1)
+# define HL_SZ(n) (sizeof(struct hl_span) * ((n) ? (n) : 1))
+
+/* bytes allocated for the render of a row and for its hl (with their gaps) */
+# define REND_SZ(rc) ((rc)->r_sz + (rc)->r_gap_l + 1)
+# define RC_HL_SZ(rc) HL_SZ((rc)->hl_n + (rc)->hl_gap_l)
+
+/* size of the blocks read when opening a file */
+# define OPEN_BLOCK_SZ (1 << 20)
+
+/* blocks written at once when saving a file (a line and its new line are two blocks at most) */
+# define SAVE_IOV 1024
+
+/* unchanged parts of a mapped file at least this big are copied by the kernel when saving (copy_file_range) */
+# define SAVE_COPY_MIN (64 << 10)
+
+/* lex rows outside the screen in a worker thread */
+# ifndef HL_THREAD
+#  define HL_THREAD 1
+# endif
+
+/* max rows and bytes in a slice of syntax work and max converged rows skipped at once */
+# define HL_SLICE 1024
+# define HL_JOB_BYTES (1 << 18)
+# define HL_SKIP (1 << 16)
+
+/* rows longer than this are drawn plain (lexing them and copying them for the worker would take too long) */
+# define HL_MAX_LINE ((INT_MAX >> 1) / TAB_SIZE)
+# define HL_PLAIN(sz) ((sz) > HL_MAX_LINE)
 
 # define HL_HL_NBR (1<<0)
 # define HL_HL_STR (1<<1)
 
+/* default separators of a syntax */
+# define HL_SEPARATORS ",.()+-/*=~%<>[];"
+
+/* max states of a compiled syntax */
+# define HL_STATES_MAX 255
+
+/* comment delimiter check of a transition */
+# define HL_DELIM_START 1
+# define HL_DELIM_END 2
+
+/* system directory of the syntax files */
+# ifndef SYN_DIR
+#  define SYN_DIR "/usr/local/share/minivim/syntax"
+# endif
+
 /*** enums ***/
 
 /* keys code enum */
@@ -59,7 +156,9 @@ enum editor_key {
 	K_HOME,
 	K_END,
 	K_PAGE_UP,
-	K_PAGE_DOWN
+	K_PAGE_DOWN,
+	/* start of a bracketed paste (read the text with editor_read_paste) */
+	K_PASTE
 };
 
 /* highlight */
@@ -76,6 +175,45 @@ enum editor_hl {
 
 /*** data ***/
 
+/* compiled keyword */
+struct hl_kw {
+	const char *kw;
+	int len;
+	int hl;
+};
+
+/* transition of the syntax DFA */
+struct hl_trans {
+	/* next state */
+	unsigned char next;
+	/* hl of the byte */
+	unsigned char hl;
+	/* a comment delimiter can start (or end) at the byte */
+	unsigned char delim;
+	/* a keyword can start at the byte */
+	unsigned char kw;
+};
+
+/* syntax compiled into a DFA (byte classes x states) */
+struct hl_dfa {
+	unsigned char cls[256];
+	unsigned char sep[256];
+	int n_cls;
+	int n_states;
+	struct hl_trans *trans;
+	/* state is a multiline comment (goes on in the next row) */
+	unsigned char *persist;
+	/* start state out of and in a multiline comment */
+	int start[2];
+	/* state after a keyword and in a one line comment */
+	int word;
+	int comment;
+	/* len of the comment delimiters */
+	int olc_l;
+	int mlcs_l;
+	int mlce_l;
+};
+
 /* editor syntax data struct */
 struct e_syntax {
 	char *f_type;
@@ -85,42 +223,196 @@ struct e_syntax {
 	char *ml_comment_st;
 	char *ml_comment_end;
 	int flags;
+	/* string quote chars, escape char in strings (0: none) and separators */
+	char *quotes;
+	int escape;
+	char *separators;
+	/* keywords compiled into a perfect hash table (when the syntax is selected) */
+	struct hl_kw *kw_list;
+	int kw_n;
+	int kw_max;
+	unsigned short *kw_slot;
+	unsigned int kw_mask;
+	unsigned int kw_seed;
+	/* lexer table (when the syntax is loaded) */
+	struct hl_dfa dfa;
+};
+
+/* run of rendered chars with the same hl (chars out of the spans are HL_NORMAL) */
+struct hl_span {
+	long st;
+	unsigned short len;
+	unsigned char hl;
+};
+
+/* max len of a span (longer runs are split) */
+# define HL_SPAN_MAX 0xffff
+
+/* growing list of spans */
+struct hl_spans {
+	struct hl_span *s;
+	int n;
+	int cap;
+};
+
+/* render column of a byte of a row (checkpoint of the column index) */
+struct col_ck {
+	long cx;
+	long rx;
+};
+
+/* column index of a long row (sorted, the first checkpoint is 0, 0) */
+struct col_idx {
+	long n;
+	long cap;
+	/* gap at the last edit (the free room, cap - n long), the checkpoints after it are relative to the end of the row */
+	long gap;
+	/* chars and render columns of the row */
+	long sz;
+	long r_sz;
+	struct col_ck ck[];
+};
+
+/* render of a row and its hl (only rows in the render cache have one) */
+struct row_rend {
+	/* render (the line itself if it has no tabs, see rend_shared) and its gap at the last edit (position and len) */
+	char *rend;
+	long r_sz;
+	long r_gap;
+	long r_gap_l;
+	/* hl spans of the render (sorted) and their gap, the spans after it start relative to the end of the render */
+	int hl_n;
+	int hl_gap;
+	int hl_gap_l;
+	struct hl_span *hl;
+	/* render cache LRU list and bytes used by render and hl */
+	struct e_row *lru_prev;
+	struct e_row *lru_next;
+	size_t rc_sz;
 };
 
-/* editor row struct */
+/* editor row struct (rows not drawn yet only have the line, render and column index are built when needed) */
 typedef struct e_row {
-	int idx;
-	int sz;
-	int r_sz;
+	/* leaf of the row tree where the row is and position in it */
+	struct rt_node *leaf;
 	char *line;
-	char *rend;
-	unsigned char *hl;
-	int hl_open_comment;
+	/* render and hl (NULL if not built) and column index (NULL if not built or the row is short) */
+	struct row_rend *rc;
+	struct col_idx *ck;
+	long sz;
+	/* gap in the line of the row being edited (position and len, 0 if the line is flat) */
+	long gap;
+	long gap_l;
+	/* changes every time render or hl of the row change (screen lines are drawn again, 64 bits so it never wraps) */
+	unsigned long long ver;
+	/* syntax generation of the checkpoint (0 if the row was edited) */
+	int hl_gen;
+	unsigned int slot : 8;
+	/* line points into the file mapping (not owned, not '\0' terminated) */
+	unsigned int mapped : 1;
+	/* render is the line itself (no tabs to expand) */
+	unsigned int rend_shared : 1;
+	/* multiline comment state at the start and end of the row (checkpoint) */
+	unsigned int hl_in : 1;
+	unsigned int hl_open_comment : 1;
 } e_row;
 
+/* row tree node (leaves hold rows, inner nodes hold children) */
+struct rt_node {
+	struct rt_node *parent;
+	/* previous and next leaf (only for leaves) */
+	struct rt_node *prev;
+	struct rt_node *next;
+	int is_leaf;
+	/* number of rows / children in the node */
+	int n;
+	/* number of rows in the subtree */
+	long cnt;
+	union {
+		struct rt_node *child[RT_CAP];
+		e_row *row[RT_CAP];
+	};
+};
+
+/* append buff struct (grows by doubling, can be reset and used again) */
+struct apbuff {
+	char *buff;
+	size_t len;
+	size_t cap;
+	/* number of times it grew */
+	size_t n_grow;
+};
+
+/* memory used by the rows (see row_mem.c) */
+struct rmem_stats {
+	/* bytes asked for and bytes in slab blocks (rounded up to their size class) */
+	size_t used;
+	size_t blocks;
+	/* number of slabs, number of big blocks and bytes in them */
+	size_t n_slabs;
+	size_t n_big;
+	size_t big;
+};
+
 /* editor config struct */
 struct editor_conf {
-	int cx, cy;
-	int rx;
-	int y_off;
-	int x_off;
+	long cx, cy;
+	long rx;
+	long y_off;
+	long x_off;
 	int scrn_rows;
 	int scrn_cols;
-	int n_rows;
-	e_row *row;
+	long n_rows;
+	struct rt_node *rows;
+	/* row with a gap in its line (the one being edited, flat again when the cursor leaves it) */
+	e_row *gap_row;
+	/* first tab after the gap of that row (chars from it to the end of the line, 0 if there is none) */
+	long gap_tab;
 	int dirty;
+	/* rows before hl_upto have a valid multiline comment state */
+	long hl_upto;
+	/* syntax generation (changes with the syntax) */
+	int hl_gen;
+	/* changes every time the rows change (syntax snapshots are old) */
+	unsigned int hl_stamp;
+	/* syntax worker notifies here when a slice is done (-1 if not running) */
+	int hl_fd;
+	/* last row version given */
+	unsigned long long row_ver;
+	/* render cache LRU list, memory used and budget */
+	e_row *rc_head;
+	e_row *rc_tail;
+	size_t rc_used;
+	size_t rc_max;
 	char *filename;
+	/* search match drawn on top of the hl of a row (render position and len) */
+	e_row *match_row;
+	long match_rx;
+	long match_len;
+	/* file mapping rows point into (MMAP_OPEN) */
+	char *map;
+	size_t map_sz;
+	/* mapped file (kept open while it is mapped) */
+	int map_fd;
 	char status_msg[80];
+	/* frame written to the terminal (memory kept between frames) and bytes of it already written */
+	struct apbuff frame;
+	size_t frame_off;
+	/* terminal output (non blocking) */
+	int out_fd;
+	/* a frame was dropped (terminal was busy), draw it when the terminal takes the last one */
+	int redraw;
 	/* 0: normal, 1: insert */
 	int	mode;
 	struct e_syntax *syntax;
 	struct termios org_termios;
 };
 
-/* append buff struct */
-struct apbuff {
-	char *buff;
-	size_t len;
+/* row tree builder (append rows in order to build a tree in one pass) */
+struct rt_builder {
+	struct rt_node *first;
+	struct rt_node *last;
+	long n_leaves;
 };
 
 /* editor_conf global var */
@@ -140,48 +432,109 @@ void editor_draw_rows(struct apbuff *ab);
 void editor_draw_status_bar(struct apbuff *ab);
 void editor_draw_msg_bar(struct apbuff *ab);
 void editor_refresh_screen();
+void editor_invalidate_screen();
 void editor_set_status_msg(const char *format, ...);
 
 /* append_buff.c */
-void apbuff_append(struct apbuff *ab, const char *s, int len);
+void apbuff_reserve(struct apbuff *ab, size_t len);
+void apbuff_append(struct apbuff *ab, const char *s, size_t len);
+void apbuff_reset(struct apbuff *ab);
 void apbuff_free(struct apbuff *ab);
 
 /* find.c */
+long editor_find_next(const char *query, long cur, int dir, long *cx);
 void editor_find_callback(char *query, int n);
 void editor_find();
 
 /* file_io.c */
-char *editor_rows_to_str(int *buff_l);
 void editor_open(const char *filename);
+void editor_unmap();
+void editor_reload();
 void editor_save();
 
 /* editor_ops.c */
 void editor_insert_char(int c);
 void editor_insert_nl();
+void editor_insert_text(char *s, size_t len);
 void editor_del_char();
 
 /* row_ops.c */
-int editor_row_cx_to_rx(e_row *row, int cx);
-int editor_row_rx_to_cx(e_row *row, int rx);
+e_row *editor_new_row(const char *s, size_t len);
+e_row *editor_new_mapped_row(char *s, size_t len);
+void editor_row_own(e_row *row);
+void editor_row_trunc(e_row *row, long len);
+void editor_row_flat(e_row *row);
+void editor_row_gap_leave();
+long editor_row_cx_to_rx(e_row *row, long cx);
+long editor_row_rx_to_cx(e_row *row, long rx);
 void editor_update_row(e_row *row);
-void editor_insert_row(int idx, char *s, size_t len);
+void editor_row_render(e_row *row);
+char *editor_rend_from(struct row_rend *rc, long at);
+void editor_rend_copy(struct row_rend *rc, char *dst, long at, long len);
+void editor_insert_row(long idx, char *s, size_t len);
 void editor_free_row(e_row *row);
-void editor_del_row(int idx);
-void editor_row_insert_char(e_row *row, int idx, int c);
+void editor_del_row(long idx);
+void editor_row_insert_char(e_row *row, long idx, int c);
 void editor_row_append_str(e_row *row, char *s, size_t len);
-void editor_row_del_char(e_row *row, int idx);
+void editor_row_del_char(e_row *row, long idx);
+
+/* row_mem.c */
+void *rmem_alloc(size_t sz);
+void rmem_free(void *p, size_t sz);
+void *rmem_realloc(void *p, size_t old_sz, size_t new_sz);
+void rmem_release();
+void rmem_get_stats(struct rmem_stats *st);
+int rmem_frag(const struct rmem_stats *st);
+
+/* rend_cache.c */
+void rcache_touch(e_row *row);
+void rcache_drop(e_row *row);
+void rcache_drop_hl();
+void rcache_evict();
+void rcache_set_max(size_t max);
+
+/* row_tree.c */
+e_row *editor_row_at(long idx);
+long editor_row_idx(e_row *row);
+e_row *editor_row_next(e_row *row);
+e_row *editor_row_prev(e_row *row);
+void rtree_insert(long idx, e_row *row);
+void rtree_remove(long idx);
+void rtree_build_append(struct rt_builder *b, e_row *row);
+void rtree_build_finish(struct rt_builder *b);
+void rtree_free();
+
+/* syntax_db.c */
+struct e_syntax *syntax_db_match(const char *filename);
+
+/* syntax_dfa.c */
+void hl_dfa_compile(struct e_syntax *syn);
 
 /* syntax_hl.c */
-int is_separator(int c);
+void editor_syntax_compile(struct e_syntax *syn);
+int editor_syntax_lex(struct e_syntax *syn, const char *s, long len, struct hl_spans *out, int in_comment);
 void editor_update_syntax(e_row *row);
+int editor_syntax_patch(e_row *row, long rx, long new_end, long delta);
+void editor_syntax_flat(struct row_rend *rc);
+int editor_syntax_span(e_row *row, long at);
+int editor_syntax_run(e_row *row, int *span, long at, long *end);
 int editor_syntax_to_color(int hl);
 void editor_select_syntax_hl();
 
+/* syntax_worker.c */
+int editor_syntax_idle(int *redraw);
+
 /* terminal.c */
 void die(const char *s);
 void dis_raw_mode();
 void enb_raw_mode();
+void editor_events_init();
+int editor_output_open();
+int editor_output_flush();
+void editor_output_drain();
+int editor_input_pending();
 int editor_read_key();
+char *editor_read_paste(size_t *len);
 int get_cursor_pos(int *rows, int *cols);
 int get_windows_size(int *rows, int *cols);
 
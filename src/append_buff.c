@@ -1,21 +1,46 @@
 #include <minivim.h>
 
-/* append new string to struct apbuff */
-void apbuff_append(struct apbuff *ab, const char *s, int len) {
+/* minimum capacity of a buffer */
+# define APBUFF_MIN 256
+
+/* make sure the buffer can store len more bytes (doubles the capacity) */
+void apbuff_reserve(struct apbuff *ab, size_t len) {
+	size_t cap;
 	char *new;
 
-	/* realloc out to make sure it can store the string we will append */
-	new = (char *)realloc(ab->buff, ab->len + len);
-	if (!new)
+	if (ab->len + len <= ab->cap)
 		return;
-	/* append string s to the new one */
-	memcpy(&new[ab->len], s, len);
-	/* change ab->buff to the new string and update len */
+
+	/* get new capacity */
+	cap = ab->cap ? ab->cap : APBUFF_MIN;
+	while (cap < ab->len + len)
+		cap *= 2;
+
+	new = (char *)realloc(ab->buff, cap);
+	if (!new)
+		die("realloc");
 	ab->buff = new;
+	ab->cap = cap;
+	ab->n_grow++;
+}
+
+/* append new string to struct apbuff */
+void apbuff_append(struct apbuff *ab, const char *s, size_t len) {
+	apbuff_reserve(ab, len);
+	/* append string s */
+	memcpy(&ab->buff[ab->len], s, len);
 	ab->len += len;
 }
 
+/* empty the buffer (memory is kept for the next use) */
+void apbuff_reset(struct apbuff *ab) {
+	ab->len = 0;
+}
+
 /* free an apbuff struct */
 void apbuff_free(struct apbuff *ab) {
 	free(ab->buff);
+	ab->buff = NULL;
+	ab->len = 0;
+	ab->cap = 0;
 }
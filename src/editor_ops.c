@@ -6,7 +6,7 @@ void editor_insert_char(int c) {
 	if (g_e.cy == g_e.n_rows)
 		editor_insert_row(g_e.n_rows, "", 0);
 	/* insert char on the row so we see it */
-	editor_row_insert_char(&g_e.row[g_e.cy], g_e.cx, c);
+	editor_row_insert_char(editor_row_at(g_e.cy), g_e.cx, c);
 	/* move cursor */
 	g_e.cx++;
 }
@@ -18,18 +18,63 @@ void editor_insert_nl() {
 		editor_insert_row(g_e.cy, "", 0);
 	/* else we will need to split the line we are on into two rows */
 	} else {
-		e_row *row = &g_e.row[g_e.cy];
+		e_row *row = editor_row_at(g_e.cy);
+		editor_row_flat(row);
 		editor_insert_row(g_e.cy + 1, &row->line[g_e.cx], row->sz - g_e.cx);
-		row = &g_e.row[g_e.cy];
-		row->sz = g_e.cx;
-		row->line[row->sz] = '\0';
-		editor_update_row(row);
+		editor_row_trunc(row, g_e.cx);
 	}
 	/* move cursor to the new line */
 	g_e.cy++;
 	g_e.cx = 0;
 }
 
+/* get end of the line that starts at i */
+static size_t editor_line_end(const char *s, size_t len, size_t i) {
+	while (i < len && s[i] != '\n' && s[i] != '\r')
+		i++;
+	return (i);
+}
+
+/* insert text at the cursor (a paste), every row is edited only once */
+void editor_insert_text(char *s, size_t len) {
+	e_row *row;
+	char *tail;
+	size_t tail_l;
+	size_t i;
+	size_t j;
+
+	/* check if we are in the tilde line to add a new row */
+	if (g_e.cy == g_e.n_rows)
+		editor_insert_row(g_e.n_rows, "", 0);
+	row = editor_row_at(g_e.cy);
+	editor_row_flat(row);
+
+	/* cut the rest of the row, it goes after the text */
+	tail_l = row->sz - g_e.cx;
+	tail = (char *)malloc(tail_l + 1);
+	if (!tail)
+		die("malloc");
+	memcpy(tail, &row->line[g_e.cx], tail_l);
+	editor_row_trunc(row, g_e.cx);
+
+	/* first line goes at the end of the row */
+	j = editor_line_end(s, len, 0);
+	editor_row_append_str(row, s, j);
+	/* the rest of the lines are new rows */
+	while (j < len) {
+		/* "\r\n" is one new line */
+		i = (s[j] == '\r' && j + 1 < len && s[j + 1] == '\n') ? j + 2 : j + 1;
+		j = editor_line_end(s, len, i);
+		editor_insert_row(++g_e.cy, &s[i], j - i);
+	}
+
+	/* put the rest of the row back after the text */
+	row = editor_row_at(g_e.cy);
+	g_e.cx = row->sz;
+	editor_row_append_str(row, tail, tail_l);
+	free(tail);
+}
+
 /* delete char */
 void editor_del_char() {
 	/* if we are past the end of the file there is nothing to delete */
@@ -41,15 +86,17 @@ void editor_del_char() {
 		return;
 
 	/* del char on the row so we see it */
-	e_row *row = &g_e.row[g_e.cy];
+	e_row *row = editor_row_at(g_e.cy);
 	if (g_e.cx > 0) {
 		editor_row_del_char(row, g_e.cx - 1);
 		g_e.cx--;
 	} else {
 		/* move cursor to end of line so it end up where the two lines will join */
-		g_e.cx = g_e.row[g_e.cy - 1].sz;
+		e_row *prev = editor_row_prev(row);
+		g_e.cx = prev->sz;
 		/* append row to the previus row */
-		editor_row_append_str(&g_e.row[g_e.cy - 1], row->line, row->sz);
+		editor_row_flat(row);
+		editor_row_append_str(prev, row->line, row->sz);
 		/* delete row (now is appended to other row) */
 		editor_del_row(g_e.cy);
 		/* move cursor again now that row is deleted */
@@ -1,27 +1,122 @@
 #include <minivim.h>
 
-/* convert rows to a string with all the file */
-char *editor_rows_to_str(int *buff_l) {
-	int i;
-	int t_len = 0;
-
-	/* calculate total len of the file */
-	for (i = 0; i < g_e.n_rows; i++)
-		t_len += g_e.row[i].sz + 1;
-	*buff_l = t_len;
-
-	/* allocate memory to store rows */
-	char *buff = (char *)malloc(t_len);
-	/* loop rows and copy all to the buffer */
-	char *ptr = buff;
-	for (i = 0; i < g_e.n_rows; i++) {
-		memcpy(ptr, g_e.row[i].line, g_e.row[i].sz);
-		ptr += g_e.row[i].sz;
-		*ptr = '\n';
-		ptr++;
+/* append a line of the file being loaded as a new row (copy it or point to it) */
+static void editor_load_line(struct rt_builder *b, char *line, size_t line_l, int mapped) {
+	/* remove carriage return characters from the line (new line is already removed) */
+	while (line_l > 0 && line[line_l - 1] == '\r')
+		line_l--;
+
+	/* create row and append it to the tree (render is built when needed) */
+	rtree_build_append(b, mapped ? editor_new_mapped_row(line, line_l) : editor_new_row(line, line_l));
+}
+
+/* read the whole file in big blocks and build all the rows in one pass */
+static void editor_load(int fd) {
+	struct rt_builder b = RT_BUILDER_INIT;
+	size_t cap = OPEN_BLOCK_SZ;
+	size_t len = 0;
+	ssize_t nread;
+
+	/* allocate read buffer */
+	char *buff = (char *)malloc(cap);
+	if (!buff)
+		die("malloc");
+
+	while (1) {
+		/* grow buffer if a line does not fit in it */
+		if (len == cap) {
+			cap *= 2;
+			buff = (char *)realloc(buff, cap);
+			if (!buff)
+				die("realloc");
+		}
+
+		/* read next block after the unfinished line */
+		nread = read(fd, &buff[len], cap - len);
+		if (nread == -1 && errno == EINTR)
+			continue;
+		if (nread == -1)
+			die("read");
+		if (nread == 0)
+			break;
+
+		/* look for new lines only in the new data (memchr is vectorized) */
+		char *st = buff;
+		char *nl = &buff[len];
+		len += nread;
+		while ((nl = memchr(nl, '\n', &buff[len] - nl))) {
+			editor_load_line(&b, st, nl - st, 0);
+			st = ++nl;
+		}
+
+		/* move the unfinished line to the start of the buffer */
+		len = &buff[len] - st;
+		memmove(buff, st, len);
+	}
+
+	/* last line with no new line at the end */
+	if (len > 0)
+		editor_load_line(&b, buff, len, 0);
+
+	/* free buffer */
+	free(buff);
+
+	/* build the row tree */
+	rtree_build_finish(&b);
+	g_e.n_rows = g_e.rows ? g_e.rows->cnt : 0;
+}
+
+/* map the whole file and build rows that point into the mapping */
+static int editor_load_map(int fd) {
+	struct rt_builder b = RT_BUILDER_INIT;
+	struct stat st;
+
+	/* only map regular files with something in them */
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+		return (-1);
+
+	/* map file (private, the file is never written through the mapping) */
+	char *map = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return (-1);
+	g_e.map = map;
+	g_e.map_sz = st.st_size;
+	g_e.map_fd = fd;
+
+	/* look for new lines (memchr is vectorized) */
+	char *end = &map[st.st_size];
+	char *line = map;
+	char *nl;
+	while ((nl = memchr(line, '\n', end - line))) {
+		editor_load_line(&b, line, nl - line, 1);
+		line = nl + 1;
 	}
+	/* last line with no new line at the end */
+	if (line < end)
+		editor_load_line(&b, line, end - line, 1);
+
+	/* build the row tree */
+	rtree_build_finish(&b);
+	g_e.n_rows = g_e.rows ? g_e.rows->cnt : 0;
 
-	return (buff);
+	return (0);
+}
+
+/* copy all the rows that point into the file mapping and unmap it */
+void editor_unmap() {
+	e_row *row;
+
+	if (!g_e.map)
+		return;
+
+	for (row = editor_row_at(0); row; row = editor_row_next(row))
+		editor_row_own(row);
+
+	munmap(g_e.map, g_e.map_sz);
+	close(g_e.map_fd);
+	g_e.map = NULL;
+	g_e.map_sz = 0;
+	g_e.map_fd = -1;
 }
 
 /* open file in editor */
@@ -34,72 +129,355 @@ void editor_open(const char *filename) {
 	editor_select_syntax_hl();
 
 	/* open file */
-	FILE *fp = fopen(filename, "r");
-	if (!fp) {
-		fp = fopen(filename, "w");
-		if (!fp) {
-			die("fopen");
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		/* create file if it does not exists */
+		fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1) {
+			die("open");
 		}
+	} else {
+		/* map or read file (the buffer is empty at this point) */
+		if (!MMAP_OPEN || editor_load_map(fd) == -1)
+			editor_load(fd);
 	}
 
-	/* read file */
-	char *line = NULL;
-	size_t linecap = 0;
-	ssize_t line_l;
-	/* read lines */
-	while ((line_l = getline(&line, &linecap, fp)) != -1) {
-		/* remove new line characters from the line (already added between rows) */
-		while (line_l > 0 && (line[line_l - 1] == '\r' || line[line_l - 1] == '\n'))
-			line_l--;
-		/* append row */
-		editor_insert_row(g_e.n_rows, line, line_l);
-	}
-
-	/* free line and close file */
-	free(line);
-	fclose(fp);
+	/* close file (a mapped file is kept open) */
+	if (fd != g_e.map_fd)
+		close(fd);
 	/* reset dirty */
 	g_e.dirty = 0;
 }
 
-/* save file in disk */
-void editor_save() {
+/* throw away the changes and load the file again */
+void editor_reload() {
+	char *filename;
+
 	/* if is a new file (with no name of course) return */
 	if (g_e.filename == NULL) {
 		editor_set_status_msg("\x1b[41mERROR: no file name\x1b[m");
 		return;
 	}
 
-	/* get string of all the file */
-	int len;
-	char *buff;
-	buff = editor_rows_to_str(&len);
+	/* free all the rows at once and open the file again (editor_open frees the name) */
+	filename = strdup(g_e.filename);
+	rtree_free();
+	editor_unmap();
+	editor_open(filename);
+	free(filename);
 
-	/* open file */
+	/* syntax state of all the rows has to be found again */
+	g_e.hl_upto = 0;
+	g_e.hl_stamp++;
+
+	/* keep cursor in the file */
+	if (g_e.cy > g_e.n_rows)
+		g_e.cy = g_e.n_rows;
+	e_row *row = (g_e.cy < g_e.n_rows) ? editor_row_at(g_e.cy) : NULL;
+	if (g_e.cx > (row ? row->sz : 0))
+		g_e.cx = row ? row->sz : 0;
+
+	editor_invalidate_screen();
+	editor_set_status_msg("\"%.20s\" %ldL, reloaded", g_e.filename, g_e.n_rows);
+}
+
+/* write n blocks (writev can take only part of them, at most 2 GB on linux) */
+static int editor_writev(int fd, struct iovec *iov, int n) {
+	ssize_t w;
+
+	while (n > 0) {
+		w = writev(fd, iov, n);
+		if (w == -1 && errno == EINTR)
+			continue;
+		if (w == -1)
+			return (-1);
+
+		/* skip the blocks that were written and the part of the next one */
+		while (n > 0 && (size_t)w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n > 0) {
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+
+	return (0);
+}
+
+/* a block is a big part of the file mapping, it can be copied from the mapped file */
+static int editor_block_copy(struct iovec *iov) {
+	char *st = (char *)iov->iov_base;
+
+	return (g_e.map && st >= g_e.map && st < &g_e.map[g_e.map_sz] && iov->iov_len >= SAVE_COPY_MIN);
+}
+
+/* copy_file_range can not copy between the files of this save (the rest of the blocks are written) */
+static int save_copy_fail = 0;
+
+/* copy a block of the file mapping from the mapped file (shared extents where the file system can), write it if it can not be copied */
+static int editor_copy(int fd, struct iovec *iov) {
+# ifdef __linux__
+	loff_t off = (char *)iov->iov_base - g_e.map;
+	ssize_t w;
+
+	while (!save_copy_fail && iov->iov_len > 0) {
+		w = copy_file_range(g_e.map_fd, &off, fd, NULL, iov->iov_len, 0);
+		if (w == -1 && errno == EINTR)
+			continue;
+		/* other file system, not supported, ... (it will fail for the other blocks too) */
+		if (w == -1 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+			save_copy_fail = 1;
+		/* any other error (or the file got shorter) */
+		if (w <= 0)
+			break;
+		iov->iov_base = (char *)iov->iov_base + w;
+		iov->iov_len -= w;
+	}
+# endif
+
+	return (editor_writev(fd, iov, 1));
+}
+
+/* write n blocks, the big ones of the file mapping are copied in the kernel (not read and written back) */
+static int editor_write_blocks(int fd, struct iovec *iov, int n) {
+	int i = 0;
+	int j;
+
+	while (i < n) {
+		for (j = i; j < n && !editor_block_copy(&iov[j]); j++)
+			;
+		if (editor_writev(fd, &iov[i], j - i) == -1)
+			return (-1);
+		if (j < n && editor_copy(fd, &iov[j]) == -1)
+			return (-1);
+		i = j + 1;
+	}
+
+	return (0);
+}
+
+/* write all the rows to a file (straight from the lines, SAVE_IOV blocks at a time) */
+static int editor_write_rows(int fd) {
+	struct iovec iov[SAVE_IOV];
+	e_row *row = editor_row_at(0);
+	int n;
+
+	/* write flat lines */
+	editor_row_flat(g_e.gap_row);
+	/* try to copy the blocks again (other files) */
+	save_copy_fail = 0;
+
+	while (row) {
+		for (n = 0; row && n + 2 <= SAVE_IOV; row = editor_row_next(row)) {
+			/* rows that follow each other in the file mapping are one block */
+			if (n && row->mapped && (char *)iov[n - 1].iov_base + iov[n - 1].iov_len == row->line) {
+				iov[n - 1].iov_len += row->sz;
+			} else {
+				iov[n].iov_base = row->line;
+				iov[n++].iov_len = row->sz;
+			}
+			/* new line (a mapped line has it after it, unless it ended with '\r' or it is the last one) */
+			if (row->mapped && &row->line[row->sz] < &g_e.map[g_e.map_sz] && row->line[row->sz] == '\n') {
+				iov[n - 1].iov_len++;
+			} else {
+				iov[n].iov_base = "\n";
+				iov[n++].iov_len = 1;
+			}
+		}
+		if (editor_write_blocks(fd, iov, n) == -1)
+			return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * the rows are written to a new file next to the one being saved, which is
+ * synced and renamed over it, so the file on disk is always either the old
+ * one or the new one (never a part of it), the rows that point into the file
+ * mapping are still good after the rename (the old file is mapped, not its
+ * name), so nothing has to be copied before saving, and the parts of the
+ * file that were not edited are copied from the old file by the kernel
+ *
+ * when the new file can not take the place of the old one as it was (no new
+ * files in the directory, other hard links to the file, an owner or extended
+ * attributes that can not be set) the file is written in place instead
+ */
+
+/* sync the directory of a file (so a rename in it is on the disk too) */
+static void editor_sync_dir(const char *path) {
+	const char *slash = strrchr(path, '/');
+	char *dir = slash ? strndup(path, slash - path + 1) : strdup(".");
 	int fd;
-	fd = open(g_e.filename, O_RDWR | O_CREAT, 0644);
+
+	if (!dir)
+		die("strdup");
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
 	if (fd != -1) {
-		/* set file size to len */
-		/* if is larger it will cut off any data at the end */
-		/* if is shorter it will add 0 bytes at the end */
-		/* this way we ensure the file haz the size of the actual content */
-		if (ftruncate(fd, len) != -1) {
-			/* write buff to file and close */
-			if (write(fd, buff, len) == len) {
-				close(fd);
-				free(buff);
-				/* reset dirty */
-				g_e.dirty = 0;
-				/* set status bar message */
-				editor_set_status_msg("\"%.20s\" %dL, written", g_e.filename ? g_e.filename : "[No Name]", g_e.n_rows);
-				return;
-			}
+		fsync(fd);
+		close(fd);
+	}
+	free(dir);
+}
+
+/* write the rows over the file itself, return -1 on error (errno is set) */
+static int editor_save_in_place(const char *path) {
+	struct stat st;
+	struct stat map_st;
+	off_t len;
+	int err;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT, 0644);
+	if (fd == -1)
+		return (-1);
+
+	/* rows can not point into the file that is being written */
+	if (g_e.map && fstat(fd, &st) == 0 && fstat(g_e.map_fd, &map_st) == 0
+		&& st.st_dev == map_st.st_dev && st.st_ino == map_st.st_ino)
+		editor_unmap();
+
+	/* write and cut what is left of the old file */
+	if (editor_write_rows(fd) == 0 && (len = lseek(fd, 0, SEEK_CUR)) != -1
+		&& ftruncate(fd, len) == 0 && fsync(fd) == 0)
+		return (close(fd));
+
+	err = errno;
+	close(fd);
+	errno = err;
+
+	return (-1);
+}
+
+/* give a new file the owner, mode and extended attributes (ACLs too) of the old one, return -1 if they can not be set */
+static int editor_save_attrs(int fd, const char *path, struct stat *st) {
+	/* owner first (it clears the set id bits of the mode) */
+	if (fchown(fd, st->st_uid, st->st_gid) == -1 || fchmod(fd, st->st_mode & 07777) == -1)
+		return (-1);
+
+# ifdef __linux__
+	ssize_t names_l = listxattr(path, NULL, 0);
+	char *names;
+	char *val;
+	ssize_t val_l;
+	int ret = 0;
+
+	if (names_l <= 0)
+		return ((names_l == -1 && errno != ENOTSUP) ? -1 : 0);
+	names = (char *)malloc(names_l);
+	if (!names)
+		die("malloc");
+	names_l = listxattr(path, names, names_l);
+	for (char *name = names; ret == 0 && name < &names[names_l]; name += strlen(name) + 1) {
+		val = NULL;
+		val_l = getxattr(path, name, NULL, 0);
+		if (val_l > 0 && !(val = (char *)malloc(val_l)))
+			die("malloc");
+		if (val_l == -1 || (val_l = getxattr(path, name, val, val_l)) == -1
+			|| fsetxattr(fd, name, val, val_l, 0) == -1)
+			ret = -1;
+		free(val);
+	}
+	free(names);
+	if (names_l == -1)
+		ret = -1;
+
+	return (ret);
+# else
+	(void)path;
+	return (0);
+# endif
+}
+
+/* write the rows to a temporary file, sync it and rename it to path, return -1 on error (errno is set) */
+static int editor_save_to(const char *path) {
+	struct stat st;
+	int exists;
+	char *tmp;
+	int err;
+	int fd;
+
+	/* other hard links to the file would keep the old one */
+	exists = (stat(path, &st) == 0);
+	if (exists && st.st_nlink > 1)
+		return (editor_save_in_place(path));
+
+	/* new file next to the old one (rename can not move it to another file system) */
+	tmp = (char *)malloc(strlen(path) + 8);
+	if (!tmp)
+		die("malloc");
+	sprintf(tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		free(tmp);
+		/* no new files in the directory (the file may still be writable) */
+		if (errno == EACCES || errno == EPERM || errno == EROFS)
+			return (editor_save_in_place(path));
+		return (-1);
+	}
+
+	/* keep owner, mode and attributes of the old file (write it in place if they can not be kept), a new file gets the default mode */
+	if (exists && editor_save_attrs(fd, path, &st) == -1) {
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return (editor_save_in_place(path));
+	} else if (!exists) {
+		mode_t mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0644 & ~mask);
+	}
+
+	/* write, get it to the disk and put it in place of the old one */
+	if (editor_write_rows(fd) == 0 && fsync(fd) == 0 && close(fd) == 0) {
+		fd = -1;
+		if (rename(tmp, path) == 0) {
+			free(tmp);
+			editor_sync_dir(path);
+			return (0);
 		}
-		/* close */
-		close (fd);
 	}
 
-	/* free buf */
-	free(buff);
+	/* remove the new file, the old one is untouched */
+	err = errno;
+	if (fd != -1)
+		close(fd);
+	unlink(tmp);
+	free(tmp);
+	errno = err;
+
+	return (-1);
+}
+
+/* save file in disk */
+void editor_save() {
+	char *path;
+
+	/* if is a new file (with no name of course) return */
+	if (g_e.filename == NULL) {
+		editor_set_status_msg("\x1b[41mERROR: no file name\x1b[m");
+		return;
+	}
+
+	/* save the file a symlink points to (and not replace the link) */
+	path = realpath(g_e.filename, NULL);
+	if (!path)
+		path = strdup(g_e.filename);
+	if (!path)
+		die("strdup");
+
+	if (editor_save_to(path) == 0) {
+		free(path);
+		/* reset dirty */
+		g_e.dirty = 0;
+		/* set status bar message */
+		editor_set_status_msg("\"%.20s\" %ldL, written", g_e.filename ? g_e.filename : "[No Name]", g_e.n_rows);
+		return;
+	}
+
 	editor_set_status_msg("Error: cant save, %s", strerror(errno));
+	free(path);
 }
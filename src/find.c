@@ -1,30 +1,51 @@
 #include <minivim.h>
 
+/*
+ * find the next row with query after row cur (before it if dir is -1, going
+ * around the end of the file), set cx to the position of the match and
+ * return the index of the row (-1 if there is no match)
+ */
+long editor_find_next(const char *query, long cur, int dir, long *cx) {
+	size_t q_len = strlen(query);
+	e_row *row = editor_row_at(cur);
+	long i;
+
+	/* search flat lines */
+	editor_row_flat(g_e.gap_row);
+
+	/* loop rows and search for next match */
+	for (i = 0; i < g_e.n_rows; i++) {
+		/* move cur one row (loop) */
+		cur += dir;
+		/* handle special cases */
+		if (cur == -1) cur = g_e.n_rows -1;
+		else if (cur == g_e.n_rows) cur = 0;
+
+		/* get row (step from the last one, or go to it if we wrapped around) */
+		if (row) row = (dir == 1) ? editor_row_next(row) : editor_row_prev(row);
+		if (!row) row = editor_row_at(cur);
+		/* check for match into row (search the line, render is built only for matches) */
+		char *match = memmem(row->line, row->sz, query, q_len);
+		if (match) {
+			*cx = match - row->line;
+			return (cur);
+		}
+	}
+
+	return (-1);
+}
+
 /* editor find callback */
 void editor_find_callback(char *query, int key) {
-	int last_match = -1;
+	long last_match = -1;
 	int dir = 1;
 
-	/* hl match saves to know which lines needs to be restored */
-	int saved_hl_line;
-	char *saved_hl = NULL;
-
 	while (1) {
-		/* restore if it is something */
-		if (saved_hl) {
-			memcpy(g_e.row[saved_hl_line].hl, saved_hl, g_e.row[saved_hl_line].r_sz);
-			free(saved_hl);
-			saved_hl = NULL;
-		}
+		/* remove match hl (it is drawn on top of the row hl, so nothing to restore) */
+		g_e.match_row = NULL;
 
 		/* return if is a special action key */
 		if (key == '\x1b') {
-			/* restore if it is something */
-			if (saved_hl) {
-				memcpy(g_e.row[saved_hl_line].hl, saved_hl, g_e.row[saved_hl_line].r_sz);
-				free(saved_hl);
-				saved_hl = NULL;
-			}
 			break;
 		/* check direction */
 		} else if (key == 'n') {
@@ -41,39 +62,23 @@ void editor_find_callback(char *query, int key) {
 
 		/* check last_match */
 		if (last_match == -1) dir = 1;
-		int cur = last_match;
-		/* loop rows and search for next match */
-		int i;
-		for (i = 0; i < g_e.n_rows; i++) {
-			/* move cur one row (loop) */
-			cur += dir;
-			/* handle special cases */
-			if (cur == -1) cur = g_e.n_rows -1;
-			else if (cur == g_e.n_rows) cur = 0;
-
-			/* get row */
-			e_row *row = &g_e.row[cur];
-			/* check for match into row */
-			char *match = strstr(row->rend, query);
-			if (match) {
-				/* update last match */
-				last_match = cur;
-				/* positionate cursor y on match */
-				g_e.cy = cur;
-				/* positionate cursor x on start of the match */
-				g_e.cx = editor_row_rx_to_cx(row, match - row->rend);
-				/* positionate match line in top of screen */
-				g_e.y_off = g_e.n_rows;
-
-				/* get saved hl (so we can restore it later) */
-				saved_hl_line = cur;
-				saved_hl = (char *)malloc(row->r_sz);
-				memcpy(saved_hl, row->hl, row->r_sz);
-				/* set hl color to match */
-				memset(&row->hl[match - row->rend], HL_MATCH, strlen(query));
-
-				break;
-			}
+		long cx;
+		long cur = editor_find_next(query, last_match, dir, &cx);
+		if (cur != -1) {
+			e_row *row = editor_row_at(cur);
+			/* update last match */
+			last_match = cur;
+			/* positionate cursor y on match */
+			g_e.cy = cur;
+			/* positionate cursor x on start of the match */
+			g_e.cx = cx;
+			/* positionate match line in top of screen */
+			g_e.y_off = g_e.n_rows;
+
+			/* hl match on top of the row hl (tabs in the query are wider in render) */
+			g_e.match_row = row;
+			g_e.match_rx = editor_row_cx_to_rx(row, g_e.cx);
+			g_e.match_len = editor_row_cx_to_rx(row, g_e.cx + strlen(query)) - g_e.match_rx;
 		}
 		/* exit for with no match in file */
 		if (last_match == -1) {
@@ -92,10 +97,10 @@ void editor_find_callback(char *query, int key) {
 /* find string in editor */
 void editor_find() {
 	/* save cursor pos */
-	int saved_cx = g_e.cx;
-	int saved_cy = g_e.cy;
-	int saved_x_off = g_e.x_off;
-	int saved_y_off = g_e.y_off;
+	long saved_cx = g_e.cx;
+	long saved_cy = g_e.cy;
+	long saved_x_off = g_e.x_off;
+	long saved_y_off = g_e.y_off;
 
 	/* change to insert mode */
 	g_e.mode = INSERT_MODE;
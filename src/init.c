@@ -11,10 +11,33 @@ void init_editor() {
 	g_e.y_off = 0;
 	g_e.x_off = 0;
 	g_e.n_rows = 0;
-	g_e.row = NULL;
+	g_e.rows = NULL;
+	g_e.gap_row = NULL;
+	g_e.gap_tab = 0;
 	g_e.dirty = 0;
+	g_e.hl_upto = 0;
+	g_e.hl_gen = 1;
+	g_e.hl_stamp = 0;
+	g_e.hl_fd = -1;
+	g_e.row_ver = 0;
+	g_e.rc_head = NULL;
+	g_e.rc_tail = NULL;
+	g_e.rc_used = 0;
+	g_e.rc_max = RCACHE_MAX;
+	g_e.match_row = NULL;
+	g_e.match_rx = 0;
+	g_e.match_len = 0;
 	g_e.filename = NULL;
+	g_e.map = NULL;
+	g_e.map_sz = 0;
+	g_e.map_fd = -1;
 	g_e.status_msg[0] = '\0';
+	g_e.frame.buff = NULL;
+	g_e.frame.len = 0;
+	g_e.frame.cap = 0;
+	g_e.frame.n_grow = 0;
+	g_e.frame_off = 0;
+	g_e.redraw = 0;
 	g_e.mode = NORMAL_MODE;
 	g_e.syntax = NULL;
 
@@ -24,4 +47,10 @@ void init_editor() {
 	
 	/* remove rows, status bar and msg bar */
 	g_e.scrn_rows -= 2;
+
+	/* open terminal output */
+	g_e.out_fd = editor_output_open();
+
+	/* wake up on resizes */
+	editor_events_init();
 }
@@ -14,11 +14,29 @@ char *editor_prompt(char *prompt, void (*callback)(char *, int)) {
 	while (1) {
 		/* set status message */
 		editor_set_status_msg(prompt, buff);
-		/* refesh screen */
-		editor_refresh_screen();
+		/* refesh screen (when the keys typed ahead are processed) */
+		if (!editor_input_pending())
+			editor_refresh_screen();
 
 		/* get key input */
 		int key = editor_read_key();
+		/* pasted text is typed in the prompt (only the first line) */
+		if (key == K_PASTE) {
+			size_t len;
+			char *paste = editor_read_paste(&len);
+			for (size_t i = 0; i < len && paste[i] != '\r' && paste[i] != '\n'; i++) {
+				if (iscntrl(paste[i]))
+					continue;
+				if (buff_l == buff_sz - 1) {
+					buff_sz *= 2;
+					buff = (char *)realloc(buff, buff_sz);
+				}
+				buff[buff_l++] = paste[i];
+				buff[buff_l] = '\0';
+			}
+			free(paste);
+			key = 0;
+		}
 		/* handle delete keys */
 		if (key == K_DEL || key == CTRL_KEY('h') || key == K_BACKSPACE) {
 			if (buff_l != 0) {
@@ -63,9 +81,42 @@ char *editor_prompt(char *prompt, void (*callback)(char *, int)) {
 	}
 }
 
+/* set editor option (":set [OPTION]=[VALUE]") */
+static void editor_set_option(char *opt) {
+	/* render cache memory budget (K, M or G suffix) */
+	if (!strncmp(opt, "rendercache=", 12)) {
+		char *end;
+		unsigned long long sz;
+		int shift = 0;
+		errno = 0;
+		sz = strtoull(opt + 12, &end, 10);
+		if (*end == 'K' || *end == 'k')
+			shift = 10;
+		else if (*end == 'M' || *end == 'm')
+			shift = 20;
+		else if (*end == 'G' || *end == 'g')
+			shift = 30;
+		if (shift)
+			end++;
+		/* check value is valid: only digits (strtoull takes a sign and wraps negative values) and it fits once shifted */
+		if (!isdigit((unsigned char)opt[12]) || errno == ERANGE || *end != '\0' || sz > (SIZE_MAX >> shift)) {
+			editor_set_status_msg("\x1b[41mERROR: invalid argument: %s\x1b[m", opt);
+			return;
+		}
+		rcache_set_max((size_t)sz << shift);
+		editor_set_status_msg("rendercache=%zuK", g_e.rc_max >> 10);
+	/* show render cache budget and memory used */
+	} else if (!strcmp(opt, "rendercache") || !strcmp(opt, "rendercache?")) {
+		editor_set_status_msg("rendercache=%zuK (%zuK used)", g_e.rc_max >> 10, g_e.rc_used >> 10);
+	} else {
+		/* not an option */
+		editor_set_status_msg("\x1b[41mERROR: unknown option: %s\x1b[m", opt);
+	}
+}
+
 /* process movement keys */
 void editor_move_cursor(int key) {
-	e_row *row = (g_e.cy >= g_e.n_rows) ? NULL : &g_e.row[g_e.cy];
+	e_row *row = editor_row_at(g_e.cy);
 	int right_off = g_e.mode == NORMAL_MODE ? 1 : 0;
 
 	/* handle key */
@@ -91,8 +142,8 @@ void editor_move_cursor(int key) {
 	}
 
 	/* positionate cursor at end of line */
-	row = (g_e.cy >= g_e.n_rows) ? NULL : &g_e.row[g_e.cy];
-	int row_l = row ? row->sz : 0;
+	row = editor_row_at(g_e.cy);
+	long row_l = row ? row->sz : 0;
 	if (g_e.cx > row_l) {
 		g_e.cx = row_l - right_off;
 	}
@@ -104,6 +155,15 @@ void editor_process_keypress() {
 
 	key = editor_read_key();
 
+	/* pasted text is inserted at once (in both modes) */
+	if (key == K_PASTE) {
+		size_t len;
+		char *paste = editor_read_paste(&len);
+		editor_insert_text(paste, len);
+		free(paste);
+		return;
+	}
+
 	/* normal mode */
 	if (g_e.mode == NORMAL_MODE) {
 		/* prompt */
@@ -120,7 +180,8 @@ void editor_process_keypress() {
 				editor_save();
 			/* exit if there are no changes */
 			} else if (!strcmp(cmd, "q") && g_e.dirty == 0) {
-				/* clear screen and move cursor before exit */
+				/* clear screen and move cursor before exit (after the last frame) */
+				editor_output_drain();
 				write(STDOUT_FILENO, "\x1b[2J", 4);
 				write(STDOUT_FILENO, "\x1b[H", 3);
 				exit(EXIT_SUCCESS);
@@ -130,7 +191,8 @@ void editor_process_keypress() {
 				editor_set_status_msg("\x1b[41mERROR: no write since last change (add ! to override)\x1b[m");
 			/* force exist with out saving */
 			} else if (!strcmp(cmd, "q!")) {
-				/* clear screen and move cursor before exit */
+				/* clear screen and move cursor before exit (after the last frame) */
+				editor_output_drain();
 				write(STDOUT_FILENO, "\x1b[2J", 4);
 				write(STDOUT_FILENO, "\x1b[H", 3);
 				exit(EXIT_SUCCESS);
@@ -138,7 +200,8 @@ void editor_process_keypress() {
 			} else if (!strcmp(cmd, "wq") || !strcmp(cmd, "x")) {
 				/* save */
 				editor_save();
-				/* clear screen and move cursor before exit */
+				/* clear screen and move cursor before exit (after the last frame) */
+				editor_output_drain();
 				write(STDOUT_FILENO, "\x1b[2J", 4);
 				write(STDOUT_FILENO, "\x1b[H", 3);
 				exit(EXIT_SUCCESS);
@@ -159,6 +222,18 @@ void editor_process_keypress() {
 				editor_select_syntax_hl();
 				/* save */
 				editor_save();
+			/* reload file (discard changes) */
+			} else if (!strcmp(cmd, "e!")) {
+				editor_reload();
+			/* show memory used by the rows */
+			} else if (!strcmp(cmd, "mem")) {
+				struct rmem_stats st;
+				rmem_get_stats(&st);
+				editor_set_status_msg("rows: %zuK used, %zu slabs, %zu big (%zuK), %d%% unused",
+					st.used >> 10, st.n_slabs, st.n_big, st.big >> 10, rmem_frag(&st));
+			/* set option */
+			} else if (!strncmp(cmd, "set ", 4)) {
+				editor_set_option(cmd + 4);
 			} else {
 				/* not an editor command */
 				editor_set_status_msg("\x1b[41mERROR: not an editor command: %s\x1b[m", cmd);
@@ -188,7 +263,7 @@ void editor_process_keypress() {
 				/* move cursor to end of line */
 				if (key == 'o') {
 					if (g_e.cy < g_e.n_rows)
-						g_e.cx = g_e.row[g_e.cy].sz;
+						g_e.cx = editor_row_at(g_e.cy)->sz;
 				}
 				/* insert nl from there */
 				editor_insert_nl();
@@ -202,14 +277,15 @@ void editor_process_keypress() {
 			g_e.cx = 0;
 		/* firts non blank */
 		} else if (key == '^') {
+			e_row *row = editor_row_at(g_e.cy);
 			g_e.cx = 0;
-			while((g_e.row[g_e.cy].line[g_e.cx] == '\t' || g_e.row[g_e.cy].line[g_e.cx] == ' ')
-				&& g_e.cx < g_e.row[g_e.cy].sz - 1)
+			while(row && g_e.cx < row->sz - 1
+				&& (ROW_CH(row, g_e.cx) == '\t' || ROW_CH(row, g_e.cx) == ' '))
 				g_e.cx++;
 		/* end key */
 		} else if (key == '$' || key == K_END) {
-			if (g_e.cy < g_e.n_rows && g_e.row[g_e.cy].sz > 0)
-				g_e.cx = g_e.row[g_e.cy].sz - 1;
+			if (g_e.cy < g_e.n_rows && editor_row_at(g_e.cy)->sz > 0)
+				g_e.cx = editor_row_at(g_e.cy)->sz - 1;
 		/* page up and page down */
 		} else if (key == K_PAGE_UP || key == K_PAGE_DOWN) {
 			/* positionate cursor before moving a page */
@@ -246,7 +322,7 @@ void editor_process_keypress() {
 		/* end key */
 		} else if (key == K_END) {
 			if (g_e.cy < g_e.n_rows)
-				g_e.cx = g_e.row[g_e.cy].sz;
+				g_e.cx = editor_row_at(g_e.cy)->sz;
 		/* delete keys */
 		} else if (key == K_BACKSPACE || key == CTRL_KEY('h') || key == K_DEL) {
 			if (key == K_DEL)
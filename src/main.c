@@ -20,8 +20,12 @@ int main(int argc, char *argv[]) {
 
 	/* program loop */
 	while (1) {
-		editor_refresh_screen();
+		/* draw only when the keys typed ahead are processed */
+		if (!editor_input_pending())
+			editor_refresh_screen();
 		editor_process_keypress();
+		/* line being edited is flat again when the cursor leaves it */
+		editor_row_gap_leave();
 	}
 
 	return (EXIT_SUCCESS);
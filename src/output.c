@@ -5,7 +5,7 @@ void editor_scroll() {
 	/* get rx */
 	g_e.rx = 0;
 	if (g_e.cy < g_e.n_rows)
-		g_e.rx = editor_row_cx_to_rx(&g_e.row[g_e.cy], g_e.cx);
+		g_e.rx = editor_row_cx_to_rx(editor_row_at(g_e.cy), g_e.cx);
 
 	/* handle vertical scroll */
 	if (g_e.cy < g_e.y_off)
@@ -19,126 +19,443 @@ void editor_scroll() {
 		g_e.x_off = g_e.rx - g_e.scrn_cols + 1;
 }
 
+/*
+ * the screen is drawn into a grid of cells (char and attributes) and compared
+ * with the frame that is on the terminal, only cursor moves and the cells that
+ * changed are written, every screen line keeps what it shows (row, version of
+ * the row, offset, cursor and search match) so lines that are the same as in
+ * the last frame are not even drawn
+ *
+ * chars and attributes are kept in separate arrays, so a row is drawn with one
+ * copy of its render and one fill per hl run, and the escape sequences of the
+ * hl classes are built once, so writing a run is two copies
+ *
+ * lines are written from their encoded bytes (escape sequences and chars, with
+ * the offset of every cell), the encoded lines of the rows are kept in a cache
+ * by row version (it changes when the row is edited or its hl changes), offset
+ * and search match, so scrolling copies bytes that are already encoded, only
+ * the line with the cursor and the status bar are encoded every time
+ *
+ * when the rows move up or down (y_off changed) the lines on the terminal are
+ * shifted with a scroll region, so only the rows that appear are written
+ */
+
+/* cell attributes: hl class (classes with the same color are merged) and reverse video */
+# define SCR_HL 0x7f
+# define SCR_REV 0x80
+
+/* hl class of the '~' of the lines after the end of the file */
+# define SCR_TILDE_HL HL_MATCH
+
+/* screen lines that do not show a row (row of the key is NULL) */
+# define SCR_TILDE 0
+# define SCR_WELCOME 1
+# define SCR_BLANK 2
+
+/* encoded lines cached for every screen line */
+# define SCR_CACHE_LINES 4
+
+/* what a screen line shows (lines with the same key are drawn the same) */
+struct scr_key {
+	e_row *row;
+	unsigned long long ver;
+	long x_off;
+	long cur_x;
+	long m_rx;
+	long m_len;
+};
+
+/* escape sequence that sets the color of a hl class */
+struct scr_sgr {
+	char s[8];
+	int len;
+	int color;
+};
+
+/* encoded line */
+struct scr_line {
+	/* row version, offset and search match it was drawn with (ver 0: none) */
+	unsigned long long ver;
+	long x_off;
+	long m_rx;
+	long m_len;
+	/* cells */
+	char *ch;
+	unsigned char *attr;
+	/* bytes that draw the line (from default attributes to default attributes) */
+	struct apbuff out;
+	/* offset of the char of every cell in out, cells after the last non blank one */
+	int *off;
+	int used;
+};
+
+/* frame on the terminal */
+static struct {
+	/* cells (rows and status bar) and what every line shows */
+	char *ch;
+	unsigned char *attr;
+	struct scr_key *keys;
+	int rows;
+	int cols;
+	/* cells are what the terminal shows (0: draw everything) */
+	int valid;
+	/* line being drawn (lines that are not cached) */
+	struct scr_line line;
+	/* encoded rows */
+	struct scr_line *cache;
+	int cache_n;
+	/* escape sequence of every hl class and class used for every hl class */
+	struct scr_sgr sgr[HL_MATCH + 1];
+	unsigned char style[HL_MATCH + 1];
+	/* offsets of the rows on the terminal */
+	long y_off;
+	long x_off;
+	/* message bar, attributes and cursor position on the terminal */
+	char msg[80];
+	int t_attr;
+	int cur_y;
+	int cur_x;
+} g_scr = {0};
+
+/* build the escape sequences of the hl classes */
+static void scr_sgr_init() {
+	for (int hl = 0; hl <= HL_MATCH; hl++) {
+		struct scr_sgr *sgr = &g_scr.sgr[hl];
+		sgr->color = (hl == HL_NORMAL) ? 39 : editor_syntax_to_color(hl);
+		sgr->len = snprintf(sgr->s, sizeof(sgr->s), "\x1b[%dm", sgr->color);
+		/* classes with the same color are drawn as the first one */
+		g_scr.style[hl] = hl;
+		for (int i = 0; i < hl; i++) {
+			if (g_scr.sgr[i].color == sgr->color) {
+				g_scr.style[hl] = i;
+				break;
+			}
+		}
+	}
+}
+
+/* allocate the cells of an encoded line (or free them if cols is 0) */
+static void scr_line_alloc(struct scr_line *l, int cols) {
+	l->ver = 0;
+	l->ch = (char *)realloc(l->ch, cols ? cols : 1);
+	l->attr = (unsigned char *)realloc(l->attr, cols ? cols : 1);
+	l->off = (int *)realloc(l->off, sizeof(int) * (cols ? cols : 1));
+	if (!l->ch || !l->attr || !l->off)
+		die("realloc");
+	if (!cols) {
+		free(l->ch);
+		free(l->attr);
+		free(l->off);
+		apbuff_free(&l->out);
+		memset(l, 0, sizeof(struct scr_line));
+	}
+}
+
+/* get the screen ready for a frame (everything is drawn again if the size changed) */
+static void scr_resize() {
+	int rows = g_e.scrn_rows + 1;
+	int cols = g_e.scrn_cols;
+	int i;
+
+	if (g_scr.ch && g_scr.rows == rows && g_scr.cols == cols)
+		return;
+
+	/* first frame */
+	if (!g_scr.ch)
+		scr_sgr_init();
+
+	/* cached lines have the old width */
+	for (i = 0; i < g_scr.cache_n; i++)
+		scr_line_alloc(&g_scr.cache[i], 0);
+
+	g_scr.rows = rows;
+	g_scr.cols = cols;
+	g_scr.ch = (char *)realloc(g_scr.ch, rows * cols);
+	g_scr.attr = (unsigned char *)realloc(g_scr.attr, rows * cols);
+	g_scr.keys = (struct scr_key *)realloc(g_scr.keys, sizeof(struct scr_key) * rows);
+	g_scr.cache_n = rows * SCR_CACHE_LINES;
+	g_scr.cache = (struct scr_line *)realloc(g_scr.cache, sizeof(struct scr_line) * g_scr.cache_n);
+	if (!g_scr.ch || !g_scr.attr || !g_scr.keys || !g_scr.cache)
+		die("realloc");
+	memset(g_scr.cache, 0, sizeof(struct scr_line) * g_scr.cache_n);
+	scr_line_alloc(&g_scr.line, cols);
+	g_scr.valid = 0;
+}
+
+/* change the attributes from *cur to attr */
+static void scr_attr(struct apbuff *ab, int *cur, int attr) {
+	if (attr == *cur)
+		return;
+
+	/* reverse video off resets the color too */
+	if ((*cur & SCR_REV) && !(attr & SCR_REV)) {
+		apbuff_append(ab, "\x1b[m", 3);
+		*cur = HL_NORMAL;
+	}
+	if (!(*cur & SCR_REV) && (attr & SCR_REV))
+		apbuff_append(ab, "\x1b[7m", 4);
+	if ((*cur & SCR_HL) != (attr & SCR_HL))
+		apbuff_append(ab, g_scr.sgr[attr & SCR_HL].s, g_scr.sgr[attr & SCR_HL].len);
+
+	*cur = attr;
+}
+
+/* clear a line */
+static void scr_line_clear(struct scr_line *l) {
+	memset(l->ch, ' ', g_scr.cols);
+	memset(l->attr, HL_NORMAL, g_scr.cols);
+}
+
+/* encode the cells of a line in runs with the same attributes */
+static void scr_line_encode(struct scr_line *l) {
+	int attr = HL_NORMAL;
+	int i = 0;
+
+	apbuff_reset(&l->out);
+
+	/* blanks at the end of the line are erased at once */
+	l->used = g_scr.cols;
+	while (l->used > 0 && l->ch[l->used - 1] == ' ' && l->attr[l->used - 1] == HL_NORMAL)
+		l->used--;
+
+	while (i < l->used) {
+		int j = i + 1;
+		while (j < l->used && l->attr[j] == l->attr[i])
+			j++;
+		scr_attr(&l->out, &attr, l->attr[i]);
+		for (int k = i; k < j; k++)
+			l->off[k] = l->out.len + k - i;
+		apbuff_append(&l->out, &l->ch[i], j - i);
+		i = j;
+	}
+
+	/* erase the rest of the line */
+	scr_attr(&l->out, &attr, HL_NORMAL);
+	for (i = l->used; i < g_scr.cols; i++)
+		l->off[i] = l->out.len;
+	if (l->used < g_scr.cols)
+		apbuff_append(&l->out, "\x1b[K", 3);
+}
+
+/* write the cells of screen line y that are not on the terminal yet (line must be encoded) */
+static void scr_line_flush(struct apbuff *ab, int y, struct scr_line *l) {
+	char *o_ch = &g_scr.ch[y * g_scr.cols];
+	unsigned char *o_attr = &g_scr.attr[y * g_scr.cols];
+	int st = 0;
+	int end = g_scr.cols;
+	char buff[32];
+
+	/* get the part of the line that changed */
+	if (g_scr.valid) {
+		if (!memcmp(o_ch, l->ch, g_scr.cols) && !memcmp(o_attr, l->attr, g_scr.cols))
+			return;
+		while (st < end && o_ch[st] == l->ch[st] && o_attr[st] == l->attr[st])
+			st++;
+		while (end > st && o_ch[end - 1] == l->ch[end - 1] && o_attr[end - 1] == l->attr[end - 1])
+			end--;
+	}
+
+	/* move cursor */
+	apbuff_append(ab, buff, snprintf(buff, sizeof(buff), "\x1b[%d;%dH", y + 1, st + 1));
+
+	/* copy the encoded bytes of the cells that changed */
+	scr_attr(ab, &g_scr.t_attr, l->attr[st]);
+	if (end <= l->used) {
+		apbuff_append(ab, &l->out.buff[l->off[st]], l->off[end - 1] + 1 - l->off[st]);
+		g_scr.t_attr = l->attr[end - 1];
+	/* and the erase at the end */
+	} else {
+		apbuff_append(ab, &l->out.buff[l->off[st]], l->out.len - l->off[st]);
+		g_scr.t_attr = HL_NORMAL;
+	}
+
+	/* the terminal has the new line now */
+	memcpy(o_ch, l->ch, g_scr.cols);
+	memcpy(o_attr, l->attr, g_scr.cols);
+}
+
+/* draw a row in a line (without cursor) */
+static void scr_line_row(struct scr_line *l, e_row *row) {
+	long x_off = g_e.x_off;
+	/* get end of the part of the row on the screen */
+	long end = row->rc->r_sz;
+	if (end > x_off + g_e.scrn_cols) end = x_off + g_e.scrn_cols;
+	if (end <= x_off) end = x_off;
+	/* first span that can be on the screen */
+	int span = editor_syntax_span(row, x_off);
+	long i;
+
+	scr_line_clear(l);
+
+	/* chars of the row on the screen at once (both sides of the gap of the render) */
+	editor_rend_copy(row->rc, l->ch, x_off, end - x_off);
+
+	/* attributes in runs of chars with the same hl */
+	for (i = x_off; i < end;) {
+		long run_end;
+		int hl = editor_syntax_run(row, &span, i, &run_end);
+		if (run_end > end) run_end = end;
+		memset(&l->attr[i - x_off], g_scr.style[hl], run_end - i);
+		i = run_end;
+	}
+
+	/* no print chars are drawn reversed */
+	for (i = 0; i < end - x_off; i++) {
+		unsigned char c = l->ch[i];
+		if (c < ' ' || c == 127) {
+			l->ch[i] = (c <= 26) ? '@' + c : '?';
+			l->attr[i] |= SCR_REV;
+		}
+	}
+}
+
+/* get the encoded line of a row (drawn and encoded if it is not in the cache) */
+static struct scr_line *scr_cache_get(e_row *row, struct scr_key *key) {
+	struct scr_line *l = &g_scr.cache[key->ver % g_scr.cache_n];
+
+	if (l->ver == key->ver && l->x_off == key->x_off && l->m_rx == key->m_rx && l->m_len == key->m_len)
+		return (l);
+
+	/* new line in the slot */
+	if (!l->ch)
+		scr_line_alloc(l, g_scr.cols);
+	l->ver = key->ver;
+	l->x_off = key->x_off;
+	l->m_rx = key->m_rx;
+	l->m_len = key->m_len;
+	scr_line_row(l, row);
+	scr_line_encode(l);
+
+	return (l);
+}
+
+/* shift the lines on the terminal if the rows moved up or down (only the new ones are drawn) */
+static void scr_scroll(struct apbuff *ab) {
+	int rows = g_e.scrn_rows;
+	int cols = g_scr.cols;
+	long d = g_e.y_off - g_scr.y_off;
+	long n = (d > 0) ? d : -d;
+	long x_off = g_scr.x_off;
+	char buff[32];
+	long i;
+
+	g_scr.y_off = g_e.y_off;
+	g_scr.x_off = g_e.x_off;
+
+	/* nothing to shift (or everything is drawn again) */
+	if (!g_scr.valid || d == 0 || n >= rows || g_e.x_off != x_off)
+		return;
+
+	/* scroll the rows (not the bars), new lines are blank */
+	scr_attr(ab, &g_scr.t_attr, HL_NORMAL);
+	apbuff_append(ab, buff, snprintf(buff, sizeof(buff), "\x1b[1;%dr", rows));
+	apbuff_append(ab, buff, snprintf(buff, sizeof(buff), (d > 0) ? "\x1b[%ldS" : "\x1b[%ldT", n));
+	apbuff_append(ab, "\x1b[r", 3);
+
+	/* the cells and keys of the lines move too */
+	if (d > 0) {
+		memmove(g_scr.ch, &g_scr.ch[n * cols], (rows - n) * cols);
+		memmove(g_scr.attr, &g_scr.attr[n * cols], (rows - n) * cols);
+		memmove(g_scr.keys, &g_scr.keys[n], sizeof(struct scr_key) * (rows - n));
+	} else {
+		memmove(&g_scr.ch[n * cols], g_scr.ch, (rows - n) * cols);
+		memmove(&g_scr.attr[n * cols], g_scr.attr, (rows - n) * cols);
+		memmove(&g_scr.keys[n], g_scr.keys, sizeof(struct scr_key) * (rows - n));
+	}
+	for (i = (d > 0) ? rows - n : 0; n--; i++) {
+		memset(&g_scr.ch[i * cols], ' ', cols);
+		memset(&g_scr.attr[i * cols], HL_NORMAL, cols);
+		memset(&g_scr.keys[i], 0, sizeof(struct scr_key));
+		g_scr.keys[i].ver = SCR_BLANK;
+	}
+}
+
+/* lines with the same key are drawn the same (compared field by field, the struct has padding) */
+static int scr_key_eq(const struct scr_key *a, const struct scr_key *b) {
+	return (a->row == b->row && a->ver == b->ver && a->x_off == b->x_off && a->cur_x == b->cur_x
+		&& a->m_rx == b->m_rx && a->m_len == b->m_len);
+}
+
 /* draw rows on editor */
 void editor_draw_rows(struct apbuff *ab) {
 	int y;
+	/* get file row where we want to start */
+	e_row *row = editor_row_at(g_e.y_off);
 
 	/* iterate rows and draw lines */
 	for (y = 0; y < g_e.scrn_rows; y++) {
-		/* get file row where we want to start */
-		int f_row = y + g_e.y_off;
-		/* if no rows to print */
-		if (f_row >= g_e.n_rows) {
-			/* if total rows == 0 means no argument, so print welcome msg */
-			if (g_e.n_rows == 0 && y == g_e.scrn_rows / 3) {
-				/* welcome message */
-				char welcome[32];
-				int welcome_l = snprintf(welcome, sizeof(welcome), "minivim - ver %s", MINIVIM_VER);
-				if (welcome_l > g_e.scrn_cols)
-					welcome_l = g_e.scrn_cols;
-				int padding = (g_e.scrn_cols - welcome_l) / 2;
-				if (padding) {
-					apbuff_append(ab, "\x1b[34m~\x1b[m", 9);
-					padding--;
-				}
-				while (padding--)
-					apbuff_append(ab, " ", 1);
-				apbuff_append(ab, welcome, welcome_l);
-			/* there is a document but no more rows to print */
-			} else {
-				/* if nothing to draw */
-				apbuff_append(ab, "\x1b[34m~\x1b[m", 9);
+		long f_row = y + g_e.y_off;
+		struct scr_key key = {NULL, SCR_TILDE, 0, -1, -1, 0};
+		struct scr_line *l = &g_scr.line;
+
+		/* get what the line shows */
+		if (f_row < g_e.n_rows) {
+			/* build render and hl if they are not up to date */
+			editor_row_render(row);
+			key.row = row;
+			key.ver = row->ver;
+			key.x_off = g_e.x_off;
+			/* get cursor position in this row (-1 if it is not here) */
+			key.cur_x = (CURSOR_HL && g_e.mode == NORMAL_MODE && y == g_e.cy - g_e.y_off) ? g_e.rx : -1;
+			if (g_e.match_row == row) {
+				key.m_rx = g_e.match_rx;
+				key.m_len = g_e.match_len;
 			}
+		/* if total rows == 0 means no argument, so print welcome msg */
+		} else if (g_e.n_rows == 0 && y == g_e.scrn_rows / 3) {
+			key.ver = SCR_WELCOME;
+		}
+
+		/* same as in the last frame, nothing to draw */
+		if (g_scr.valid && scr_key_eq(&g_scr.keys[y], &key)) {
+			if (key.row)
+				row = editor_row_next(row);
+			continue;
+		}
+		g_scr.keys[y] = key;
+
 		/* draw actual row */
-		} else {
-			/* get row len */
-			int len = g_e.row[f_row].r_sz - g_e.x_off;
-			if (len < 0) len = 0;
-			if (len > g_e.scrn_cols) len = g_e.scrn_cols;
-			/* get string to draw */
-			char *c = &g_e.row[f_row].rend[g_e.x_off];
-			/* get hl string */
-			unsigned char *hl = &g_e.row[f_row].hl[g_e.x_off];
-			/* for optimization record current color so we not do extra writes */
-			int cur_color = -1;
-			/* loop row */
-			int i;
-			for (i = 0; i < len; i++) {
-				/* handle cursor */
-				if (CURSOR_HL && g_e.mode == NORMAL_MODE && y == g_e.cy - g_e.y_off && i == g_e.rx - g_e.x_off) {
-					/* change color on cursor position only */
-					apbuff_append(ab, "\x1b[m", 4);
-					apbuff_append(ab, "\x1b[7m", 4);
-					apbuff_append(ab, &c[i], 1);
-					apbuff_append(ab, "\x1b[m", 4);
-					/* print escape secuence for cur color so we not cut hl */
-					if (cur_color != -1) {
-						char buff[16];
-						int c_len = snprintf(buff, sizeof(buff), "\x1b[%dm", cur_color);
-						apbuff_append(ab, buff, c_len);
-					}
-				/* handle no print chars */
-				} else if (iscntrl(c[i])) {
-					char sym = (c[i] <= 26) ? '@' + c[i] : '?';
-					apbuff_append(ab, "\x1b[7m", 4);
-					apbuff_append(ab, &sym, 1);
-					apbuff_append(ab, "\x1b[m", 3);
-					/* print escape secuence for cur color so we not cut hl */
-					if (cur_color != -1) {
-						char buff[16];
-						int c_len = snprintf(buff, sizeof(buff), "\x1b[%dm", cur_color);
-						apbuff_append(ab, buff, c_len);
-					}
-				/* if normal color (white) */
-				} else if (hl[i] == HL_NORMAL) {
-					if (cur_color != -1) {
-						/* set color */
-						cur_color = -1;
-						/* append color */
-						apbuff_append(ab, "\x1b[39m", 5);
-					}
-					/* append char */
-					apbuff_append(ab, &c[i], 1);
-				/* handle syntax hl */
-				} else {
-					/* get color */
-					int color = editor_syntax_to_color(hl[i]);
-					if (color != cur_color) {
-						/* set color */
-						cur_color = color;
-						/* get color escape char len */
-						char buff[16];
-						int c_len = snprintf(buff, sizeof(buff), "\x1b[%dm", color);
-						/* append color */
-						apbuff_append(ab, buff, c_len);
-					}
-					/* append char */
-					apbuff_append(ab, &c[i], 1);
-				}
+		if (key.row) {
+			l = scr_cache_get(row, &key);
+			/* cursor is drawn on top of a copy (cursor on empty lines too) */
+			long cur = key.cur_x - key.x_off;
+			if (key.cur_x != -1 && cur >= 0 && (cur < row->rc->r_sz - key.x_off || row->sz == 0) && cur < g_scr.cols) {
+				memcpy(g_scr.line.ch, l->ch, g_scr.cols);
+				memcpy(g_scr.line.attr, l->attr, g_scr.cols);
+				l = &g_scr.line;
+				l->attr[cur] = HL_NORMAL | SCR_REV;
+				scr_line_encode(l);
 			}
-			/* handle cursor on empty lines */
-			if (CURSOR_HL && g_e.mode == NORMAL_MODE && y == g_e.cy - g_e.y_off && g_e.row[f_row].sz == 0) {
-				apbuff_append(ab, "\x1b[m", 4);
-				apbuff_append(ab, "\x1b[7m", 4);
-				apbuff_append(ab, " ", 1);
-				apbuff_append(ab, "\x1b[m", 4);
+			/* go to next row */
+			row = editor_row_next(row);
+		/* welcome message */
+		} else if (key.ver == SCR_WELCOME) {
+			char welcome[32];
+			int welcome_l = snprintf(welcome, sizeof(welcome), "minivim - ver %s", MINIVIM_VER);
+			if (welcome_l > g_e.scrn_cols)
+				welcome_l = g_e.scrn_cols;
+			int padding = (g_e.scrn_cols - welcome_l) / 2;
+			scr_line_clear(l);
+			if (padding) {
+				l->ch[0] = '~';
+				l->attr[0] = g_scr.style[SCR_TILDE_HL];
 			}
-			/* reset to normal color */
-			apbuff_append(ab, "\x1b[39m", 5);
+			memcpy(&l->ch[padding], welcome, welcome_l);
+			scr_line_encode(l);
+		/* there is a document but no more rows to print */
+		} else {
+			scr_line_clear(l);
+			l->ch[0] = '~';
+			l->attr[0] = g_scr.style[SCR_TILDE_HL];
+			scr_line_encode(l);
 		}
 
-		/* erase part of the line to the right of the cursor */
-		apbuff_append(ab, "\x1b[K", 3);
-		/* dont write a new line on the last row */
-		apbuff_append(ab, "\r\n", 2);
+		scr_line_flush(ab, y, l);
 	}
 }
 
 /* draw status bar */
 void editor_draw_status_bar(struct apbuff *ab) {
-	/* invert draw color */
-	apbuff_append(ab, "\x1b[7m", 4);
-
 	/* draw file name */
 	char status[80];
 	char r_status[80];
@@ -149,33 +466,36 @@ void editor_draw_status_bar(struct apbuff *ab) {
 	/* get status bar end string data */
 	int r_len;
 	/* get status bar end string */
-	r_len = snprintf(r_status, sizeof(r_status), "%s | %d/%d",
+	r_len = snprintf(r_status, sizeof(r_status), "%s | %ld/%ld",
 		g_e.syntax ? g_e.syntax->f_type : "no ft",
 		g_e.cy + 1,g_e.n_rows);
 	/* append file name and file lines */
 	if (len > g_e.scrn_cols) len = g_e.scrn_cols;
-	apbuff_append(ab, status, len);
 
-	/* draw status bar */
-	while (len < g_e.scrn_cols) {
-		if (g_e.scrn_cols - len == r_len) {
-			apbuff_append(ab, r_status, r_len);
-			break;
-		} else {
-			apbuff_append(ab, " ", 1);
-			len++;
-		}
-	}
+	/* whole bar is inverted */
+	memset(g_scr.line.ch, ' ', g_e.scrn_cols);
+	memset(g_scr.line.attr, HL_NORMAL | SCR_REV, g_e.scrn_cols);
+	memcpy(g_scr.line.ch, status, len);
+	/* end string on the right (if it fits) */
+	if (g_e.scrn_cols - len >= r_len)
+		memcpy(&g_scr.line.ch[g_e.scrn_cols - r_len], r_status, r_len);
 
-	/* reset draw color */
-	apbuff_append(ab, "\x1b[m", 3);
-	/* add new line for message bar */
-	apbuff_append(ab, "\r\n", 2);
+	scr_line_encode(&g_scr.line);
+	scr_line_flush(ab, g_e.scrn_rows, &g_scr.line);
 }
 
 /* draw message bar */
 void editor_draw_msg_bar(struct apbuff *ab) {
-	/* */
+	char buff[32];
+
+	/* same message (it can have escape sequences, so it is not in the cells) */
+	if (g_scr.valid && !strcmp(g_scr.msg, g_e.status_msg))
+		return;
+	strcpy(g_scr.msg, g_e.status_msg);
+
+	/* move to the message bar and erase it */
+	apbuff_append(ab, buff, snprintf(buff, sizeof(buff), "\x1b[%d;1H", g_e.scrn_rows + 2));
+	scr_attr(ab, &g_scr.t_attr, HL_NORMAL);
 	apbuff_append(ab, "\x1b[K", 3);
 
 	/* */
@@ -183,40 +503,80 @@ void editor_draw_msg_bar(struct apbuff *ab) {
 	if (msg_l > g_e.scrn_cols) msg_l = g_e.scrn_cols;
 	/* apped to buff */
 	apbuff_append(ab, g_e.status_msg, msg_l);
+	/* reset the attributes the message set */
+	apbuff_append(ab, "\x1b[m", 3);
+}
+
+/* draw everything again in the next frame (terminal was cleared or changed) */
+void editor_invalidate_screen() {
+	g_scr.valid = 0;
 }
 
 /* refresh editor screen */
 void editor_refresh_screen() {
+	/* frame buffer (memory of the last frame is used again) */
+	struct apbuff *ab = &g_e.frame;
+
 	/* handle vertical scroll */
 	editor_scroll();
 
-	/* initialise struct */
-	struct apbuff ab = APBUFF_INIT;
+	/* terminal did not take the last frame yet, drop this one (drawn when it does) */
+	if (editor_output_flush()) {
+		g_e.redraw = 1;
+		return;
+	}
+	g_e.redraw = 0;
 
-	/* hide cursor when drawing on screen */
-	apbuff_append(&ab, "\x1b[?25l", 6);
-	/* move cursor */
-	apbuff_append(&ab, "\x1b[H", 3);
+	/* get screen ready */
+	scr_resize();
+	apbuff_reset(ab);
+	g_e.frame_off = 0;
+
+	/* start update, hide cursor when drawing on screen */
+	if (SYNC_UPDATE)
+		apbuff_append(ab, "\x1b[?2026h", 8);
+	apbuff_append(ab, "\x1b[?25l", 6);
+	size_t head = ab->len;
 
+	/* shift rows that are still on the screen */
+	scr_scroll(ab);
 	/* draw rows */
-	editor_draw_rows(&ab);
+	editor_draw_rows(ab);
 	/* draw status bar and msg bar*/
-	editor_draw_status_bar(&ab);
-	editor_draw_msg_bar(&ab);
+	editor_draw_status_bar(ab);
+	editor_draw_msg_bar(ab);
+	/* leave default attributes on the terminal */
+	scr_attr(ab, &g_scr.t_attr, HL_NORMAL);
+	g_scr.valid = 1;
 
-	/* get cursor pos and move cursor */
-	char buff[32];
-	snprintf(buff, sizeof(buff), "\x1b[%d;%dH", (g_e.cy - g_e.y_off) + 1, (g_e.rx - g_e.x_off) + 1);
-	apbuff_append(&ab, buff, strlen(buff));
+	/* get cursor pos */
+	int cur_y = (int)(g_e.cy - g_e.y_off) + 1;
+	int cur_x = (int)(g_e.rx - g_e.x_off) + 1;
+
+	/* nothing changed, no need to hide the cursor */
+	int drawn = (ab->len > head);
+	if (!drawn) {
+		apbuff_reset(ab);
+		/* and no need to move it if it did not move */
+		if (cur_y == g_scr.cur_y && cur_x == g_scr.cur_x)
+			return;
+	}
 
-	/* show cursor again (finish drawing) */
-	apbuff_append(&ab, "\x1b[?25h", 6);
+	/* move cursor */
+	char buff[32];
+	apbuff_append(ab, buff, snprintf(buff, sizeof(buff), "\x1b[%d;%dH", cur_y, cur_x));
+	g_scr.cur_y = cur_y;
+	g_scr.cur_x = cur_x;
 
-	/* write buffer on screen */
-	write(STDOUT_FILENO, ab.buff, ab.len);
+	/* show cursor again, end update (finish drawing) */
+	if (drawn) {
+		apbuff_append(ab, "\x1b[?25h", 6);
+		if (SYNC_UPDATE)
+			apbuff_append(ab, "\x1b[?2026l", 8);
+	}
 
-	/* free buffer */
-	apbuff_free(&ab);
+	/* write buffer on screen (the rest is written while waiting for keys) */
+	editor_output_flush();
 }
 
 /* set status message */
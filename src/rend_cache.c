@@ -0,0 +1,114 @@
+#include <minivim.h>
+
+/*
+ * render and hl of the rows are built only when they are needed (drawing,
+ * search match) and kept in a LRU list, when the memory used by them is over
+ * the budget the least recently used rows (far from the viewport) are dropped
+ */
+
+/* get bytes used by render and hl of a row (a render shared with the line takes nothing) */
+static size_t rcache_row_sz(e_row *row) {
+	struct row_rend *rc = row->rc;
+	size_t sz = sizeof(struct row_rend);
+
+	if (!row->rend_shared)
+		sz += REND_SZ(rc);
+	if (rc->hl)
+		sz += RC_HL_SZ(rc);
+
+	return (sz);
+}
+
+/* remove row from the LRU list */
+static void rcache_unlink(e_row *row) {
+	struct row_rend *rc = row->rc;
+
+	if (rc->lru_prev)
+		rc->lru_prev->rc->lru_next = rc->lru_next;
+	else
+		g_e.rc_head = rc->lru_next;
+	if (rc->lru_next)
+		rc->lru_next->rc->lru_prev = rc->lru_prev;
+	else
+		g_e.rc_tail = rc->lru_prev;
+	rc->lru_prev = NULL;
+	rc->lru_next = NULL;
+
+	/* update memory used */
+	g_e.rc_used -= rc->rc_sz;
+	rc->rc_sz = 0;
+}
+
+/* move row to the head of the LRU list (most recently used) */
+void rcache_touch(e_row *row) {
+	struct row_rend *rc = row->rc;
+
+	/* nothing to keep */
+	if (!rc)
+		return;
+
+	/* unlink if it is already in the list */
+	if (rc->rc_sz)
+		rcache_unlink(row);
+
+	/* insert at head */
+	rc->rc_sz = rcache_row_sz(row);
+	rc->lru_next = g_e.rc_head;
+	if (g_e.rc_head)
+		g_e.rc_head->rc->lru_prev = row;
+	else
+		g_e.rc_tail = row;
+	g_e.rc_head = row;
+
+	/* update memory used */
+	g_e.rc_used += rc->rc_sz;
+}
+
+/* free render and hl of a row */
+void rcache_drop(e_row *row) {
+	struct row_rend *rc = row->rc;
+
+	if (!rc)
+		return;
+	if (rc->rc_sz)
+		rcache_unlink(row);
+
+	/* a shared render is the line, it is not ours */
+	if (!row->rend_shared)
+		rmem_free(rc->rend, REND_SZ(rc));
+	rmem_free(rc->hl, RC_HL_SZ(rc));
+	rmem_free(rc, sizeof(struct row_rend));
+	row->rc = NULL;
+	row->rend_shared = 0;
+}
+
+/* free the hl of all the rows (syntax changed) */
+void rcache_drop_hl() {
+	e_row *row;
+
+	for (row = g_e.rc_head; row; row = row->rc->lru_next) {
+		struct row_rend *rc = row->rc;
+		rmem_free(rc->hl, RC_HL_SZ(rc));
+		rc->hl = NULL;
+		rc->hl_n = 0;
+		rc->hl_gap = 0;
+		rc->hl_gap_l = 0;
+		/* update memory used */
+		g_e.rc_used -= rc->rc_sz;
+		rc->rc_sz = rcache_row_sz(row);
+		g_e.rc_used += rc->rc_sz;
+	}
+}
+
+/* drop least recently used rows until memory used is under the budget */
+void rcache_evict() {
+	/* never drop the most recently used row, it is being used right now */
+	while (g_e.rc_used > g_e.rc_max && g_e.rc_tail && g_e.rc_tail != g_e.rc_head)
+		rcache_drop(g_e.rc_tail);
+}
+
+/* set memory budget */
+void rcache_set_max(size_t max) {
+	g_e.rc_max = max;
+	rcache_evict();
+}
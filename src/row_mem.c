@@ -0,0 +1,244 @@
+#include <minivim.h>
+
+/*
+ * rows, their lines, the data built from them (render, hl spans and column
+ * index) and the nodes of the row tree are allocated from slabs of RMEM_SLAB
+ * bytes, every slab is cut in blocks of one size class and the free blocks of
+ * a class are kept in a list (linked through the blocks), callers give the
+ * size back when they free a block so blocks have no header, the ones bigger
+ * than the largest class are malloc'ed with a small header that links them,
+ * so a buffer is closed by freeing a few slabs and not every row (only the UI
+ * thread uses it, the syntax worker has its own copies)
+ */
+
+/* size classes: multiples of 16, four per power of two (at most 25% is lost rounding up) */
+# define RMEM_N_CLS 28
+# define RMEM_MAX 4096
+
+/* headers keep the blocks after them 16 bytes aligned */
+# define RMEM_HDR(t) ((sizeof(t) + 15) & ~(size_t)15)
+
+/* slab header (slabs are linked to free them all at once) */
+struct rmem_slab {
+	struct rmem_slab *next;
+};
+
+/* header of a block bigger than the largest class */
+struct rmem_big {
+	struct rmem_big *prev;
+	struct rmem_big *next;
+	size_t sz;
+};
+
+/* free block of a class */
+struct rmem_free {
+	struct rmem_free *next;
+};
+
+/* size of every class and class of every size (in 16 bytes steps) */
+static size_t rmem_cls_sz[RMEM_N_CLS];
+static unsigned char rmem_cls[RMEM_MAX / 16 + 1];
+
+/* free blocks and part of the last slab of every class not cut yet */
+static struct rmem_free *rmem_free_l[RMEM_N_CLS];
+static char *rmem_cur[RMEM_N_CLS];
+static char *rmem_end[RMEM_N_CLS];
+
+static struct rmem_slab *rmem_slabs = NULL;
+static struct rmem_big *rmem_bigs = NULL;
+static struct rmem_stats rmem_st = {0};
+
+/* fill the class tables */
+static void rmem_init() {
+	size_t sz = 16;
+	int c;
+	int i;
+
+	for (c = 0; c < RMEM_N_CLS; c++) {
+		rmem_cls_sz[c] = sz;
+		/* 16 bytes steps up to 128, then four steps per power of two */
+		sz += (sz < 128) ? 16 : (size_t)1 << (31 - __builtin_clz(sz) - 2);
+	}
+	for (i = 0, c = 0; i <= RMEM_MAX / 16; i++) {
+		while (rmem_cls_sz[c] < (size_t)i * 16)
+			c++;
+		rmem_cls[i] = c;
+	}
+}
+
+/* get the class of a size (not bigger than RMEM_MAX) */
+static int rmem_class(size_t sz) {
+	if (!rmem_cls_sz[0])
+		rmem_init();
+	return (rmem_cls[(sz + 15) >> 4]);
+}
+
+/* allocate a block bigger than the largest class */
+static void *rmem_big_alloc(size_t sz) {
+	struct rmem_big *big;
+
+	big = (struct rmem_big *)malloc(RMEM_HDR(struct rmem_big) + sz);
+	if (!big)
+		die("malloc");
+	big->sz = sz;
+	big->prev = NULL;
+	big->next = rmem_bigs;
+	if (rmem_bigs)
+		rmem_bigs->prev = big;
+	rmem_bigs = big;
+
+	rmem_st.n_big++;
+	rmem_st.big += sz;
+	rmem_st.used += sz;
+
+	return ((char *)big + RMEM_HDR(struct rmem_big));
+}
+
+/* unlink a big block (before it is freed or moved) */
+static void rmem_big_unlink(struct rmem_big *big) {
+	if (big->prev)
+		big->prev->next = big->next;
+	else
+		rmem_bigs = big->next;
+	if (big->next)
+		big->next->prev = big->prev;
+
+	rmem_st.n_big--;
+	rmem_st.big -= big->sz;
+	rmem_st.used -= big->sz;
+}
+
+/* allocate sz bytes */
+void *rmem_alloc(size_t sz) {
+	struct rmem_slab *slab;
+	void *p;
+	int c;
+
+	if (sz > RMEM_MAX)
+		return (rmem_big_alloc(sz));
+
+	c = rmem_class(sz);
+	rmem_st.used += sz;
+	rmem_st.blocks += rmem_cls_sz[c];
+
+	/* reuse a free block */
+	if (rmem_free_l[c]) {
+		p = rmem_free_l[c];
+		rmem_free_l[c] = rmem_free_l[c]->next;
+		return (p);
+	}
+
+	/* no space left in the slab of the class, get a new one */
+	if (rmem_end[c] - rmem_cur[c] < (ptrdiff_t)rmem_cls_sz[c]) {
+		slab = (struct rmem_slab *)malloc(RMEM_SLAB);
+		if (!slab)
+			die("malloc");
+		slab->next = rmem_slabs;
+		rmem_slabs = slab;
+		rmem_cur[c] = (char *)slab + RMEM_HDR(struct rmem_slab);
+		rmem_end[c] = (char *)slab + RMEM_SLAB;
+		rmem_st.n_slabs++;
+	}
+
+	/* cut the next block of the slab */
+	p = rmem_cur[c];
+	rmem_cur[c] += rmem_cls_sz[c];
+
+	return (p);
+}
+
+/* free a block of sz bytes (the size it was allocated or reallocated to) */
+void rmem_free(void *p, size_t sz) {
+	struct rmem_free *blk = (struct rmem_free *)p;
+	int c;
+
+	if (!p)
+		return;
+
+	if (sz > RMEM_MAX) {
+		struct rmem_big *big = (struct rmem_big *)((char *)p - RMEM_HDR(struct rmem_big));
+		rmem_big_unlink(big);
+		free(big);
+		return;
+	}
+
+	c = rmem_class(sz);
+	rmem_st.used -= sz;
+	rmem_st.blocks -= rmem_cls_sz[c];
+	blk->next = rmem_free_l[c];
+	rmem_free_l[c] = blk;
+}
+
+/* resize a block of old_sz bytes to new_sz bytes (nothing is moved if the class is the same) */
+void *rmem_realloc(void *p, size_t old_sz, size_t new_sz) {
+	void *q;
+
+	if (!p)
+		return (rmem_alloc(new_sz));
+
+	/* same class, the block already has room */
+	if (old_sz <= RMEM_MAX && new_sz <= RMEM_MAX && rmem_class(old_sz) == rmem_class(new_sz)) {
+		rmem_st.used += new_sz - old_sz;
+		return (p);
+	}
+
+	/* big to big, let realloc move it */
+	if (old_sz > RMEM_MAX && new_sz > RMEM_MAX) {
+		struct rmem_big *big = (struct rmem_big *)((char *)p - RMEM_HDR(struct rmem_big));
+		rmem_big_unlink(big);
+		big = (struct rmem_big *)realloc(big, RMEM_HDR(struct rmem_big) + new_sz);
+		if (!big)
+			die("realloc");
+		big->sz = new_sz;
+		big->prev = NULL;
+		big->next = rmem_bigs;
+		if (rmem_bigs)
+			rmem_bigs->prev = big;
+		rmem_bigs = big;
+		rmem_st.n_big++;
+		rmem_st.big += new_sz;
+		rmem_st.used += new_sz;
+		return ((char *)big + RMEM_HDR(struct rmem_big));
+	}
+
+	/* move to a block of the new class */
+	q = rmem_alloc(new_sz);
+	memcpy(q, p, (old_sz < new_sz) ? old_sz : new_sz);
+	rmem_free(p, old_sz);
+
+	return (q);
+}
+
+/* free every block at once (all the rows of the buffer are gone) */
+void rmem_release() {
+	while (rmem_slabs) {
+		struct rmem_slab *next = rmem_slabs->next;
+		free(rmem_slabs);
+		rmem_slabs = next;
+	}
+	while (rmem_bigs) {
+		struct rmem_big *next = rmem_bigs->next;
+		free(rmem_bigs);
+		rmem_bigs = next;
+	}
+
+	memset(rmem_free_l, 0, sizeof(rmem_free_l));
+	memset(rmem_cur, 0, sizeof(rmem_cur));
+	memset(rmem_end, 0, sizeof(rmem_end));
+	memset(&rmem_st, 0, sizeof(rmem_st));
+}
+
+/* get memory stats */
+void rmem_get_stats(struct rmem_stats *st) {
+	*st = rmem_st;
+}
+
+/* get the part of the memory taken from the system that is not in use (percent) */
+int rmem_frag(const struct rmem_stats *st) {
+	size_t total = st->n_slabs * RMEM_SLAB + st->big;
+
+	if (!total)
+		return (0);
+
+	return ((int)((total - st->used) * 100 / total));
+}
@@ -1,13 +1,172 @@
 #include <minivim.h>
 
+/*
+ * long rows keep a sparse index of the render column of a byte every
+ * COL_STEP bytes or so, so converting between cx and rx is a binary search
+ * and a scan of a few bytes, the index is built the first time it is needed,
+ * the edits of a char only touch the checkpoints around its gap (see
+ * editor_row_patch) and edits of the whole line drop it
+ */
+
+/* bytes of a column index with room for cap checkpoints */
+# define COL_IDX_SZ(cap) (sizeof(struct col_idx) + sizeof(struct col_ck) * (cap))
+
+/* get the first tab of the line of a row from idx (-1 if there is none) */
+static long editor_row_tab(e_row *row, long idx) {
+	char *t;
+	long off;
+
+	/* part of the line before the gap */
+	if (row->gap_l && idx < row->gap) {
+		t = memchr(&row->line[idx], '\t', row->gap - idx);
+		if (t)
+			return (t - row->line);
+		idx = row->gap;
+	}
+	if (idx >= row->sz)
+		return (-1);
+
+	/* rest of the line (after the gap) */
+	off = (row->gap_l && idx >= row->gap) ? row->gap_l : 0;
+	t = memchr(&row->line[idx + off], '\t', row->sz - idx);
+
+	return (t ? t - row->line - off : -1);
+}
+
+/* free the column index of a row */
+static void editor_row_ck_drop(e_row *row) {
+	if (!row->ck)
+		return;
+	rmem_free(row->ck, COL_IDX_SZ(row->ck->cap));
+	row->ck = NULL;
+}
+
+/* get checkpoint k of a column index (the ones after the gap are relative to the end of the row) */
+static struct col_ck editor_row_ck_at(struct col_idx *ci, long k) {
+	struct col_ck ck;
+
+	if (k < ci->gap)
+		return (ci->ck[k]);
+	ck = ci->ck[k + ci->cap - ci->n];
+	ck.cx += ci->sz;
+	ck.rx += ci->r_sz;
+
+	return (ck);
+}
+
+/* move the gap of a column index before checkpoint k */
+static void editor_row_ck_gap(struct col_idx *ci, long k) {
+	long gap_l = ci->cap - ci->n;
+
+	/* the checkpoints that go after the gap are relative to the end of the row now and the other way round */
+	for (; ci->gap > k; ci->gap--) {
+		struct col_ck *ck = &ci->ck[ci->gap - 1 + gap_l];
+		*ck = ci->ck[ci->gap - 1];
+		ck->cx -= ci->sz;
+		ck->rx -= ci->r_sz;
+	}
+	for (; ci->gap < k; ci->gap++) {
+		struct col_ck *ck = &ci->ck[ci->gap];
+		*ck = ci->ck[ci->gap + gap_l];
+		ck->cx += ci->sz;
+		ck->rx += ci->r_sz;
+	}
+}
+
+/* add a checkpoint to the column index of a row at its gap (create the index if it has none) */
+static void editor_row_ck_add(e_row *row, long cx, long rx) {
+	struct col_idx *ci = row->ck;
+
+	if (!ci) {
+		ci = (struct col_idx *)rmem_alloc(COL_IDX_SZ(16));
+		ci->n = 0;
+		ci->cap = 16;
+		ci->gap = 0;
+		ci->sz = row->sz;
+		ci->r_sz = 0;
+	} else if (ci->n == ci->cap) {
+		/* the checkpoints after the gap go to the end */
+		ci = (struct col_idx *)rmem_realloc(ci, COL_IDX_SZ(ci->cap), COL_IDX_SZ(ci->cap * 2));
+		memmove(&ci->ck[ci->gap + ci->cap], &ci->ck[ci->gap], sizeof(struct col_ck) * (ci->n - ci->gap));
+		ci->cap *= 2;
+	}
+	row->ck = ci;
+
+	ci->ck[ci->gap].cx = cx;
+	ci->ck[ci->gap].rx = rx;
+	ci->gap++;
+	ci->n++;
+}
+
+/* build the column index of a long row (if it does not have it) */
+static void editor_row_ck_build(e_row *row) {
+	long rx = 0;
+	long i = 0;
+	long tab;
+	long k;
+
+	if (row->ck || row->sz < COL_STEP * 2)
+		return;
+
+	/* chars between tabs take one column each, so only the tabs are visited */
+	editor_row_ck_add(row, 0, 0);
+	tab = editor_row_tab(row, 0);
+	for (k = COL_STEP; k < row->sz; k += COL_STEP) {
+		while (tab != -1 && tab < k) {
+			rx += tab - i;
+			rx += TAB_SIZE - rx % TAB_SIZE;
+			i = tab + 1;
+			tab = editor_row_tab(row, i);
+		}
+		rx += k - i;
+		i = k;
+		editor_row_ck_add(row, k, rx);
+	}
+
+	/* render columns of the whole row */
+	while (tab != -1) {
+		rx += tab - i;
+		rx += TAB_SIZE - rx % TAB_SIZE;
+		i = tab + 1;
+		tab = editor_row_tab(row, i);
+	}
+	row->ck->r_sz = rx + row->sz - i;
+}
+
+/* get the last checkpoint of a row at or before cx (or render column rx) */
+static long editor_row_ck_find(e_row *row, long v, int by_rx) {
+	struct col_idx *ci = row->ck;
+	long lo = 0;
+	long hi = ci->n;
+
+	while (hi - lo > 1) {
+		long mid = (lo + hi) / 2;
+		struct col_ck ck = editor_row_ck_at(ci, mid);
+		if ((by_rx ? ck.rx : ck.cx) <= v)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return (lo);
+}
+
 /* calculate rx */
-int editor_row_cx_to_rx(e_row *row, int cx) {
-	int rx = 0;
-	int i;
+long editor_row_cx_to_rx(e_row *row, long cx) {
+	long rx = 0;
+	long i = 0;
+
+	/* start from the last checkpoint before cx */
+	editor_row_ck_build(row);
+	if (row->ck) {
+		struct col_ck ck = editor_row_ck_at(row->ck, editor_row_ck_find(row, cx, 0));
+		i = ck.cx;
+		rx = ck.rx;
+	}
 
 	/* iterate line and calculate len with tabs included */
-	for (i = 0; i < cx; i++) {
-		if (row->line[i] == '\t')
+	for (; i < cx; i++) {
+		if (ROW_CH(row, i) == '\t')
 			rx += (TAB_SIZE - 1) - (rx % TAB_SIZE);
 		rx++;
 	}
@@ -16,14 +175,22 @@ int editor_row_cx_to_rx(e_row *row, int cx) {
 }
 
 /* calculate cx */
-int editor_row_rx_to_cx(e_row *row, int rx) {
-	int cx;
-	int cur_rx = 0;
+long editor_row_rx_to_cx(e_row *row, long rx) {
+	long cx = 0;
+	long cur_rx = 0;
+
+	/* start from the last checkpoint before rx */
+	editor_row_ck_build(row);
+	if (row->ck) {
+		struct col_ck ck = editor_row_ck_at(row->ck, editor_row_ck_find(row, rx, 1));
+		cx = ck.cx;
+		cur_rx = ck.rx;
+	}
 
 	/* loop row */
-	for (cx = 0; cx < row->sz; cx++) {
+	for (; cx < row->sz; cx++) {
 		/* handle tab size */
-		if (row->line[cx] == '\t')
+		if (ROW_CH(row, cx) == '\t')
 			cur_rx += (TAB_SIZE - 1) - (cur_rx % TAB_SIZE);
 		/* handle every other char */
 		cur_rx++;
@@ -37,73 +204,471 @@ int editor_row_rx_to_cx(e_row *row, int rx) {
 	return (cx);
 }
 
-/* update row */
+/*
+ * n_ins chars were inserted at idx (or n_del deleted), the render columns
+ * after idx move by d_mid up to the tab at position tab (new line, -1 if
+ * none) and by delta after it: move the gap of the index after idx (the
+ * checkpoints after it move with the end of the row), fix the ones before the
+ * tab and split the part of the index where the chars went if it is too long
+ * now
+ */
+static void editor_row_ck_shift(e_row *row, long idx, long n, long tab, long d_mid, long delta) {
+	struct col_idx *ci = row->ck;
+	long k = editor_row_ck_find(row, idx, 0);
+	long i;
+
+	editor_row_ck_gap(ci, k + 1);
+	ci->sz += n;
+	ci->r_sz += delta;
+	for (i = k + 1; tab != -1 && i < ci->n && editor_row_ck_at(ci, i).cx <= tab; i++)
+		ci->ck[i + ci->cap - ci->n].rx += d_mid - delta;
+
+	/* bytes from checkpoint k to the next one (or the end of the line) */
+	struct col_ck ck = editor_row_ck_at(ci, k);
+	long end = (k + 1 < ci->n) ? editor_row_ck_at(ci, k + 1).cx : row->sz;
+	if (end - ck.cx > COL_STEP * 2) {
+		long cx = ck.cx;
+		long rx = ck.rx;
+		for (; cx < ck.cx + COL_STEP; cx++) {
+			if (ROW_CH(row, cx) == '\t')
+				rx += (TAB_SIZE - 1) - (rx % TAB_SIZE);
+			rx++;
+		}
+		editor_row_ck_add(row, cx, rx);
+	}
+}
+
+/* row text changed, drop render and hl (they are built again when needed) */
+static void editor_row_changed(e_row *row) {
+	rcache_drop(row);
+	/* syntax checkpoint is not valid anymore */
+	row->hl_gen = 0;
+	/* draw it again */
+	row->ver = ++g_e.row_ver;
+
+	/* syntax state of this row (and the ones after it) has to be checked again */
+	long idx = editor_row_idx(row);
+	if (idx < g_e.hl_upto)
+		g_e.hl_upto = idx;
+	g_e.hl_stamp++;
+}
+
+/* row text changed, drop render, hl and column index */
 void editor_update_row(e_row *row) {
-	int tabs = 0;
-	int i;
-
-	/* count tabs */
-	for (i = 0; i < row->sz; i++) {
-		if (row->line[i] == '\t') tabs++;
-	}
-	/* free old rend and allocate the new one */
-	free(row->rend);
-	row->rend = (char *)malloc(row->sz + tabs * (TAB_SIZE - 1) + 1);
-
-	/* copy line chars to rend and handle tabs */
-	int idx = 0;
-	for (i = 0; i < row->sz; i++) {
-		if (row->line[i] == '\t') {
-			row->rend[idx++] = ' ';
-			while (idx % TAB_SIZE)
-				row->rend[idx++] = ' ';
-		} else if (row->line[i] == ' ') {
-			row->rend[idx++] = ' ';
+	editor_row_ck_drop(row);
+	editor_row_changed(row);
+}
+
+/* build render and hl of a row if they are not up to date */
+void editor_row_render(e_row *row) {
+	struct row_rend *rc = row->rc;
+	long r_sz = 0;
+	long i;
+
+	/* build render */
+	if (!rc) {
+		rc = (struct row_rend *)rmem_alloc(sizeof(struct row_rend));
+		rc->r_gap = 0;
+		rc->r_gap_l = 0;
+		rc->hl = NULL;
+		rc->hl_n = 0;
+		rc->hl_gap = 0;
+		rc->hl_gap_l = 0;
+		rc->lru_prev = NULL;
+		rc->lru_next = NULL;
+		rc->rc_sz = 0;
+		row->rc = rc;
+
+		/* nothing to expand, the line (if it is flat) is the render (memchr is vectorized) */
+		if (!row->gap_l && !memchr(row->line, '\t', row->sz)) {
+			rc->rend = row->line;
+			rc->r_sz = row->sz;
+			row->rend_shared = 1;
 		} else {
-			row->rend[idx++] = row->line[i];
+			/* get render size (allocated exactly, the size is given back when it is freed) */
+			for (i = 0; i < row->sz; i++) {
+				if (ROW_CH(row, i) == '\t')
+					r_sz += TAB_SIZE - r_sz % TAB_SIZE;
+				else
+					r_sz++;
+			}
+
+			/* allocate rend */
+			rc->rend = (char *)rmem_alloc(r_sz + 1);
+
+			/* copy line chars to rend and handle tabs */
+			long idx = 0;
+			for (i = 0; i < row->sz; i++) {
+				char c = ROW_CH(row, i);
+				if (c == '\t') {
+					rc->rend[idx++] = ' ';
+					while (idx % TAB_SIZE)
+						rc->rend[idx++] = ' ';
+				} else {
+					rc->rend[idx++] = c;
+				}
+			}
+
+			/* set '\0' at end of string and set render size */
+			rc->rend[idx] = '\0';
+			rc->r_sz = idx;
 		}
 	}
 
-	/* set '\0' at end of string and set render size */
-	row->rend[idx] = '\0';
-	row->r_sz = idx;
-
-	/* update syntax */
+	/* update syntax (only if it is not up to date) */
 	editor_update_syntax(row);
+
+	/* mark row as recently used and drop old rows if we are over budget */
+	rcache_touch(row);
+	rcache_evict();
 }
 
-/* insert / append row */
-void editor_insert_row(int idx, char *s, size_t len) {
-	/* check index is valid */
-	if (idx < 0 || idx > g_e.n_rows)
+/*
+ * the render of the row being edited has a gap too, at the end of the last
+ * change (or where its hl was lexed from), so a change only moves the render
+ * between the old and the new position of the gap, the chars are read with
+ * REND_CH or the gap is moved before the part that is read at once
+ */
+
+/* move the gap of a render to at (grow it if it has less than need bytes) */
+static void editor_rend_gap(struct row_rend *rc, long at, long need) {
+	/* no space left, grow the render (the tail and the '\0' go to the end) */
+	if (rc->r_gap_l < need) {
+		long gap_l = need + ((rc->r_sz / 2 + GAP_MIN < GAP_MAX) ? rc->r_sz / 2 + GAP_MIN : GAP_MAX);
+		rc->rend = (char *)rmem_realloc(rc->rend, REND_SZ(rc), rc->r_sz + gap_l + 1);
+		memmove(&rc->rend[rc->r_gap + gap_l], &rc->rend[rc->r_gap + rc->r_gap_l], rc->r_sz - rc->r_gap + 1);
+		rc->r_gap_l = gap_l;
+	}
+
+	/* move the bytes between the gap and at to the other side of it (nothing to move if the render is flat) */
+	if (rc->r_gap_l && at < rc->r_gap)
+		memmove(&rc->rend[at + rc->r_gap_l], &rc->rend[at], rc->r_gap - at);
+	else if (rc->r_gap_l && at > rc->r_gap)
+		memmove(&rc->rend[rc->r_gap], &rc->rend[rc->r_gap + rc->r_gap_l], at - rc->r_gap);
+	rc->r_gap = at;
+}
+
+/* get the render of a row with the chars from at to the end in one piece (char i is at [i] from at on) */
+char *editor_rend_from(struct row_rend *rc, long at) {
+	editor_rend_gap(rc, at, 0);
+	return (rc->rend + rc->r_gap_l);
+}
+
+/* copy len chars of a render from at */
+void editor_rend_copy(struct row_rend *rc, char *dst, long at, long len) {
+	long n = 0;
+
+	/* part before the gap and part after it */
+	if (at < rc->r_gap) {
+		n = (rc->r_gap - at < len) ? rc->r_gap - at : len;
+		memcpy(dst, &rc->rend[at], n);
+	}
+	memcpy(&dst[n], &rc->rend[at + n + rc->r_gap_l], len - n);
+}
+
+/* make the render and the hl of a row flat again (close their gaps) */
+static void editor_rend_flat(e_row *row) {
+	struct row_rend *rc = row->rc;
+
+	if (!rc)
+		return;
+	editor_syntax_flat(rc);
+	if (rc->r_gap_l) {
+		memmove(&rc->rend[rc->r_gap], &rc->rend[rc->r_gap + rc->r_gap_l], rc->r_sz - rc->r_gap + 1);
+		rc->rend = (char *)rmem_realloc(rc->rend, REND_SZ(rc), rc->r_sz + 1);
+		rc->r_gap_l = 0;
+	}
+	rc->r_gap = 0;
+
+	/* it takes less memory now */
+	rcache_touch(row);
+}
+
+/* give a row its own copy of a render shared with the line (the line is going to change in place) */
+static void editor_row_unshare(e_row *row) {
+	struct row_rend *rc = row->rc;
+
+	if (!row->rend_shared)
 		return;
 
-	/* realloc e_row struct to allocate all rows */
-	g_e.row = (e_row *)realloc(g_e.row, sizeof(e_row) * (g_e.n_rows + 1));
-	if (!g_e.row)
-		die("realloc");
+	rc->rend = (char *)rmem_alloc(rc->r_sz + 1);
+	memcpy(rc->rend, row->line, rc->r_sz);
+	rc->rend[rc->r_sz] = '\0';
+	rc->r_gap = 0;
+	rc->r_gap_l = 0;
+	row->rend_shared = 0;
+
+	/* it takes memory now */
+	rcache_touch(row);
+}
+
+/* create a new row (not inserted in the row tree) */
+e_row *editor_new_row(const char *s, size_t len) {
+	e_row *row;
+
+	/* allocate new row */
+	row = (e_row *)rmem_alloc(sizeof(e_row));
+
+	/* copy line */
+	row->sz = len;
+	row->line = (char *)rmem_alloc(len + 1);
+	memcpy(row->line, s, len);
+	row->line[len] = '\0';
+	row->mapped = 0;
+	row->gap = 0;
+	row->gap_l = 0;
+	row->ck = NULL;
 
-	/* shift rows */
-	memmove(&g_e.row[idx + 1], &g_e.row[idx], sizeof(e_row) * (g_e.n_rows - idx));
+	/* initialise render (built when needed) */
+	row->rc = NULL;
+	row->rend_shared = 0;
+	row->hl_in = 0;
+	row->hl_open_comment = 0;
+	row->hl_gen = 0;
+	row->ver = ++g_e.row_ver;
 
-	/* update index of the row (displaced by insert) */
-	for (int i = idx + 1; i <= g_e.n_rows; i++) g_e.row[i].idx++;
+	return (row);
+}
+
+/* create a new row that points into the file mapping (not inserted in the row tree) */
+e_row *editor_new_mapped_row(char *s, size_t len) {
+	e_row *row;
+
+	/* allocate new row */
+	row = (e_row *)rmem_alloc(sizeof(e_row));
+
+	/* point to the line, it will be copied the first time it is edited */
+	row->sz = len;
+	row->line = s;
+	row->mapped = 1;
+	row->gap = 0;
+	row->gap_l = 0;
+	row->ck = NULL;
+
+	/* initialise render (built when needed) */
+	row->rc = NULL;
+	row->rend_shared = 0;
+	row->hl_in = 0;
+	row->hl_open_comment = 0;
+	row->hl_gen = 0;
+	row->ver = ++g_e.row_ver;
 
-	/* set row index to index */
-	g_e.row[idx].idx = idx;
+	return (row);
+}
+
+/* copy line of a mapped row to the heap so it can be edited */
+void editor_row_own(e_row *row) {
+	char *line;
 
-	/* insert / append row */
-	g_e.row[idx].sz = len;
-	g_e.row[idx].line = (char *)malloc(len + 1);
-	memcpy(g_e.row[idx].line, s, len);
-	g_e.row[idx].line[len] = '\0';
+	if (!row->mapped)
+		return;
 
-	/* initialise render */
-	g_e.row[idx].r_sz = 0;
-	g_e.row[idx].rend = NULL;
-	g_e.row[idx].hl = NULL;
-	g_e.row[idx].hl_open_comment = 0;
-	editor_update_row(&g_e.row[idx]);
+	/* copy line */
+	line = (char *)rmem_alloc(row->sz + 1);
+	memcpy(line, row->line, row->sz);
+	line[row->sz] = '\0';
+
+	/* now the row owns the line (and the render if it is the line) */
+	row->line = line;
+	row->mapped = 0;
+	if (row->rend_shared)
+		row->rc->rend = line;
+}
+
+/* cut the line of a row at len */
+void editor_row_trunc(e_row *row, long len) {
+	/* get our own flat copy of the line before editing it */
+	editor_row_flat(row);
+	editor_row_own(row);
+	/* give the space of the tail back */
+	row->line = (char *)rmem_realloc(row->line, row->sz + 1, len + 1);
+	row->sz = len;
+	row->line[row->sz] = '\0';
+	/* update row */
+	editor_update_row(row);
+}
+
+/*
+ * the row being edited gets a gap at the cursor, so typing and deleting only
+ * move the bytes between the old and the new position of the gap (nothing if
+ * the cursor did not move), the gap grows with the line (amortized O(1)
+ * inserts on long lines) and the line is flat again when the cursor leaves it
+ * (its render, hl and column index too, they have gaps at the same place)
+ */
+
+/* make the line of a row flat again (close its gap) */
+void editor_row_flat(e_row *row) {
+	if (!row)
+		return;
+	if (g_e.gap_row == row)
+		g_e.gap_row = NULL;
+	editor_rend_flat(row);
+	if (row->ck)
+		editor_row_ck_gap(row->ck, row->ck->n);
+	if (!row->gap_l)
+		return;
+
+	/* move the tail (and the '\0') over the gap and give the space back */
+	memmove(&row->line[row->gap], &row->line[row->gap + row->gap_l], row->sz - row->gap + 1);
+	row->line = (char *)rmem_realloc(row->line, ROW_LINE_SZ(row), row->sz + 1);
+	row->gap = 0;
+	row->gap_l = 0;
+}
+
+/* flatten the row being edited if the cursor is not on it anymore */
+void editor_row_gap_leave() {
+	if (g_e.gap_row && (g_e.cy >= g_e.n_rows || editor_row_at(g_e.cy) != g_e.gap_row))
+		editor_row_flat(g_e.gap_row);
+}
+
+/* move the gap of a row to idx (open it if the line is flat or the gap is full) */
+static void editor_row_gap(e_row *row, long idx) {
+	char *t;
+
+	/* only one row has a gap */
+	if (g_e.gap_row != row)
+		editor_row_flat(g_e.gap_row);
+	g_e.gap_row = row;
+
+	/* get our own copy of the line (and the render) before editing it */
+	editor_row_unshare(row);
+	editor_row_own(row);
+
+	/* no space left, grow the line (with room for the '\0' after the tail) */
+	if (!row->gap_l) {
+		long gap_l = row->sz / 2 + GAP_MIN;
+		if (gap_l > GAP_MAX)
+			gap_l = GAP_MAX;
+		row->line = (char *)rmem_realloc(row->line, row->sz + 1, row->sz + gap_l + 1);
+		memmove(&row->line[idx + gap_l], &row->line[idx], row->sz - idx + 1);
+		row->gap = idx;
+		row->gap_l = gap_l;
+		t = memchr(&row->line[idx + gap_l], '\t', row->sz - idx);
+		g_e.gap_tab = t ? &row->line[row->sz + gap_l] - t : 0;
+		return;
+	}
+
+	/* move the bytes between the gap and idx to the other side of it (look for the first tab after it in them only) */
+	if (idx < row->gap) {
+		memmove(&row->line[idx + row->gap_l], &row->line[idx], row->gap - idx);
+		t = memchr(&row->line[idx + row->gap_l], '\t', row->gap - idx);
+		if (t)
+			g_e.gap_tab = &row->line[row->sz + row->gap_l] - t;
+	} else if (idx > row->gap) {
+		memmove(&row->line[row->gap], &row->line[row->gap + row->gap_l], idx - row->gap);
+		if (g_e.gap_tab > row->sz - idx) {
+			t = memchr(&row->line[idx + row->gap_l], '\t', row->sz - idx);
+			g_e.gap_tab = t ? &row->line[row->sz + row->gap_l] - t : 0;
+		}
+	}
+	row->gap = idx;
+}
+
+/*
+ * n_ins chars were inserted at idx of a row (or a char old_w wide in the
+ * render was deleted there), the gap of the line is right after them and rx
+ * is the render position of idx: patch the column index and the render
+ * before their gaps and expand only the new chars and the next tab (the chars
+ * after it keep their tab stops, the gaps take the difference), then patch
+ * the hl (render and hl are dropped if they are not built), so a key costs
+ * the same on any line (up to the next tab)
+ */
+static void editor_row_patch(e_row *row, long idx, long rx, long old_w, long n_ins) {
+	struct row_rend *rc;
+	long new_w = 0;
+	long old_end;
+	long new_end;
+	long mid = 0;
+	long tab;
+	long delta;
+	long at;
+	long i;
+
+	/* nothing to patch */
+	if (!row->rc && !row->ck) {
+		editor_row_changed(row);
+		return;
+	}
+
+	/* render width of the new chars */
+	for (i = 0; i < n_ins; i++)
+		new_w += (ROW_CH(row, idx + i) == '\t') ? TAB_SIZE - (rx + new_w) % TAB_SIZE : 1;
+
+	/* chars up to the next tab move with the change, the ones after it are still on the same tab stop */
+	old_end = rx + old_w;
+	new_end = rx + new_w;
+	tab = g_e.gap_tab ? row->sz - g_e.gap_tab : -1;
+	if (tab != -1) {
+		mid = tab - idx - n_ins;
+		old_end += mid;
+		old_end += TAB_SIZE - old_end % TAB_SIZE;
+		new_end += mid;
+		new_end += TAB_SIZE - new_end % TAB_SIZE;
+	}
+	delta = new_end - old_end;
+
+	if (row->ck)
+		editor_row_ck_shift(row, idx, n_ins - (old_w > 0), tab, new_w - old_w, delta);
+	if (!row->rc) {
+		editor_row_changed(row);
+		return;
+	}
+	rc = row->rc;
+
+	/* the old chars up to the end of the tab go before the gap, move the ones before the tab */
+	editor_rend_gap(rc, old_end, delta);
+	memmove(&rc->rend[rx + new_w], &rc->rend[rx + old_w], mid);
+	rc->r_gap = new_end;
+	rc->r_gap_l -= delta;
+	rc->r_sz += delta;
+
+	/* expand the tab and the new chars */
+	if (tab != -1)
+		memset(&rc->rend[rx + new_w + mid], ' ', new_end - rx - new_w - mid);
+	for (i = 0, at = rx; i < n_ins; i++) {
+		char c = ROW_CH(row, idx + i);
+		if (c == '\t') {
+			rc->rend[at++] = ' ';
+			while (at % TAB_SIZE)
+				rc->rend[at++] = ' ';
+		} else {
+			rc->rend[at++] = c;
+		}
+	}
+
+	/* re-lex around the change (or build hl again when drawn, also if the row was too long to have hl before) */
+	if (HL_PLAIN(row->sz - n_ins + (old_w > 0)) || !editor_syntax_patch(row, rx, new_end, delta)) {
+		rmem_free(rc->hl, RC_HL_SZ(rc));
+		rc->hl = NULL;
+		rc->hl_n = 0;
+		rc->hl_gap = 0;
+		rc->hl_gap_l = 0;
+		row->hl_gen = 0;
+		long r_idx = editor_row_idx(row);
+		if (r_idx < g_e.hl_upto)
+			g_e.hl_upto = r_idx;
+	}
+	rcache_touch(row);
+
+	/* draw it again, syntax snapshots are old */
+	row->ver = ++g_e.row_ver;
+	g_e.hl_stamp++;
+}
+
+/* insert / append row */
+void editor_insert_row(long idx, char *s, size_t len) {
+	e_row *row;
+
+	/* check index is valid */
+	if (idx < 0 || idx > g_e.n_rows)
+		return;
+
+	/* create new row */
+	row = editor_new_row(s, len);
+
+	/* insert row in the row tree (no need to shift the other rows) */
+	rtree_insert(idx, row);
+	editor_update_row(row);
 
 	/* increase number of rows */
 	g_e.n_rows++;
@@ -113,25 +678,32 @@ void editor_insert_row(int idx, char *s, size_t len) {
 
 /* free row */
 void editor_free_row(e_row *row) {
-	free(row->rend);
-	free(row->line);
-	free(row->hl);
+	if (g_e.gap_row == row)
+		g_e.gap_row = NULL;
+	editor_row_ck_drop(row);
+	rcache_drop(row);
+	if (!row->mapped)
+		rmem_free(row->line, ROW_LINE_SZ(row));
 }
 
 /* delete row */
-void editor_del_row(int idx) {
+void editor_del_row(long idx) {
+	e_row *row;
+
 	/* check index is valid */
 	if (idx < 0 || idx >= g_e.n_rows)
 		return;
 
-	/* delete row */
-	editor_free_row(&g_e.row[idx]);
+	/* syntax state of the rows after it has to be checked again */
+	if (idx < g_e.hl_upto)
+		g_e.hl_upto = idx;
+	g_e.hl_stamp++;
 
-	/* shift rest of the rows */
-	memmove(&g_e.row[idx], &g_e.row[idx + 1], sizeof(e_row) * (g_e.n_rows - idx - 1));
-
-	/* update index of the row (displaced by delete) */
-	for (int i = idx; i < g_e.n_rows - 1; i++) g_e.row[i].idx--;
+	/* remove row from the row tree and delete it */
+	row = editor_row_at(idx);
+	rtree_remove(idx);
+	editor_free_row(row);
+	rmem_free(row, sizeof(e_row));
 
 	/* update number of rows */
 	g_e.n_rows--;
@@ -140,34 +712,39 @@ void editor_del_row(int idx) {
 }
 
 /* insert char in a row */
-void editor_row_insert_char(e_row *row, int idx, int c) {
+void editor_row_insert_char(e_row *row, long idx, int c) {
 	/* check idx is valid */
 	if (idx < 0 || idx > row->sz)
 		idx = row->sz;
 
-	/* realloc line so it can store one more char */
-	row->line = (char *)realloc(row->line, row->sz + 2);
-	/* shift line one position from where we will add the char */
-	/* memmove to prevent overlap, we are in the same string */
-	memmove(&row->line[idx + 1], &row->line[idx], row->sz - idx + 1);
+	/* render position of the char (to patch the render) */
+	long rx = (row->rc || row->ck) ? editor_row_cx_to_rx(row, idx) : 0;
+
+	/* move the gap to where we will add the char */
+	editor_row_gap(row, idx);
+	/* insert char at the start of the gap */
+	row->line[row->gap++] = c;
+	row->gap_l--;
 	/* update row size */
 	row->sz++;
-	/* insert chart */
-	row->line[idx] = c;
-	/* update row */
-	editor_update_row(row);
+	/* update render and hl of the row */
+	editor_row_patch(row, idx, rx, 0, 1);
 	/* increase dirty (we make changes) */
 	g_e.dirty++;
 }
 
 /* append str to a row */
 void editor_row_append_str(e_row *row, char *s, size_t len) {
+	/* get our own flat copy of the line before editing it */
+	editor_row_flat(row);
+	editor_row_own(row);
 	/* allocate space for the append */
-	row->line = (char *)realloc(row->line, row->sz + len + 1);
+	row->line = (char *)rmem_realloc(row->line, row->sz + 1, row->sz + len + 1);
 	/* append string */
 	memcpy(&row->line[row->sz], s, len);
 	/* update row size */
 	row->sz += len;
+	row->line[row->sz] = '\0';
 	/* update row */
 	editor_update_row(row);
 	/* set dirty */
@@ -175,15 +752,22 @@ void editor_row_append_str(e_row *row, char *s, size_t len) {
 }
 
 /* delete char in a row */
-void editor_row_del_char(e_row *row, int idx) {
+void editor_row_del_char(e_row *row, long idx) {
 	/* check idx is valid */
 	if (idx < 0 || idx >= row->sz)
 		return;
 
-	/* shift line one position left */
-	memmove(&row->line[idx], &row->line[idx + 1], row->sz - idx);
+	/* render position and width of the char (to patch the render) */
+	long rx = (row->rc || row->ck) ? editor_row_cx_to_rx(row, idx) : 0;
+	long w = (ROW_CH(row, idx) == '\t') ? TAB_SIZE - rx % TAB_SIZE : 1;
+
+	/* move the gap after the char and make the gap take it */
+	editor_row_gap(row, idx + 1);
+	row->gap--;
+	row->gap_l++;
 	/* update row size */
 	row->sz--;
-	editor_update_row(row);
+	/* update render and hl of the row */
+	editor_row_patch(row, idx, rx, w, 0);
 	g_e.dirty++;
 }
@@ -0,0 +1,322 @@
+#include <minivim.h>
+
+/*
+ * rows are stored in a counted B+ tree, leaves hold pointers to the rows and
+ * every node knows how many rows are below it, so line numbers are implicit
+ * (no need to renumber rows after an insert or a delete)
+ */
+
+/* allocate a new node */
+static struct rt_node *rtree_new_node(int is_leaf) {
+	struct rt_node *node;
+
+	node = (struct rt_node *)rmem_alloc(sizeof(struct rt_node));
+	memset(node, 0, sizeof(struct rt_node));
+	node->is_leaf = is_leaf;
+
+	return (node);
+}
+
+/* update slot of the rows in a leaf from position st */
+static void rtree_fix_slots(struct rt_node *leaf, int st) {
+	for (int i = st; i < leaf->n; i++) {
+		leaf->row[i]->leaf = leaf;
+		leaf->row[i]->slot = i;
+	}
+}
+
+/* add n to the row count of node and all its parents */
+static void rtree_add_cnt(struct rt_node *node, long n) {
+	while (node) {
+		node->cnt += n;
+		node = node->parent;
+	}
+}
+
+/* get position of a child in its parent */
+static int rtree_child_pos(struct rt_node *node) {
+	struct rt_node *parent = node->parent;
+	int i;
+
+	for (i = 0; i < parent->n; i++) {
+		if (parent->child[i] == node)
+			break;
+	}
+
+	return (i);
+}
+
+/* insert child in parent at position pos */
+static void rtree_insert_child(struct rt_node *parent, int pos, struct rt_node *child) {
+	memmove(&parent->child[pos + 1], &parent->child[pos], sizeof(struct rt_node *) * (parent->n - pos));
+	parent->child[pos] = child;
+	child->parent = parent;
+	parent->n++;
+}
+
+/* split a full node in two, the new node is placed right after it */
+static void rtree_split(struct rt_node *node) {
+	struct rt_node *new;
+	int half = node->n / 2;
+	int i;
+
+	/* node is the root, grow the tree one level */
+	if (!node->parent) {
+		struct rt_node *root = rtree_new_node(0);
+		rtree_insert_child(root, 0, node);
+		root->cnt = node->cnt;
+		g_e.rows = root;
+	}
+	/* make room in the parent first if it is full */
+	if (node->parent->n == RT_CAP)
+		rtree_split(node->parent);
+
+	/* move second half to the new node */
+	new = rtree_new_node(node->is_leaf);
+	new->n = node->n - half;
+	node->n = half;
+	if (node->is_leaf) {
+		memcpy(new->row, &node->row[half], sizeof(e_row *) * new->n);
+		rtree_fix_slots(new, 0);
+		new->cnt = new->n;
+		/* link leaves */
+		new->next = node->next;
+		new->prev = node;
+		if (node->next)
+			node->next->prev = new;
+		node->next = new;
+	} else {
+		memcpy(new->child, &node->child[half], sizeof(struct rt_node *) * new->n);
+		for (i = 0; i < new->n; i++) {
+			new->child[i]->parent = new;
+			new->cnt += new->child[i]->cnt;
+		}
+	}
+	node->cnt -= new->cnt;
+
+	/* insert new node after the old one (count of the parent does not change) */
+	rtree_insert_child(node->parent, rtree_child_pos(node) + 1, new);
+}
+
+/* remove an empty node from the tree */
+static void rtree_unlink(struct rt_node *node) {
+	struct rt_node *parent = node->parent;
+
+	/* unlink leaf */
+	if (node->is_leaf) {
+		if (node->prev)
+			node->prev->next = node->next;
+		if (node->next)
+			node->next->prev = node->prev;
+	}
+
+	/* last node of the tree */
+	if (!parent) {
+		g_e.rows = NULL;
+		rmem_free(node, sizeof(struct rt_node));
+		return;
+	}
+
+	/* remove from parent */
+	int pos = rtree_child_pos(node);
+	memmove(&parent->child[pos], &parent->child[pos + 1], sizeof(struct rt_node *) * (parent->n - pos - 1));
+	parent->n--;
+	rmem_free(node, sizeof(struct rt_node));
+
+	/* remove parent too if it is empty now */
+	if (parent->n == 0)
+		rtree_unlink(parent);
+}
+
+/* get the row at index idx */
+e_row *editor_row_at(long idx) {
+	struct rt_node *node = g_e.rows;
+
+	/* check index is valid */
+	if (!node || idx < 0 || idx >= node->cnt)
+		return (NULL);
+
+	/* go down the tree subtracting the rows we skip */
+	while (!node->is_leaf) {
+		int i = 0;
+		while (idx >= node->child[i]->cnt) {
+			idx -= node->child[i]->cnt;
+			i++;
+		}
+		node = node->child[i];
+	}
+
+	return (node->row[idx]);
+}
+
+/* get the index of a row */
+long editor_row_idx(e_row *row) {
+	struct rt_node *node = row->leaf;
+	long idx = row->slot;
+
+	/* add the rows of every node on the left of the path to the root */
+	while (node->parent) {
+		struct rt_node *parent = node->parent;
+		for (int i = 0; parent->child[i] != node; i++)
+			idx += parent->child[i]->cnt;
+		node = parent;
+	}
+
+	return (idx);
+}
+
+/* get next row (NULL if last) */
+e_row *editor_row_next(e_row *row) {
+	if (row->slot + 1 < row->leaf->n)
+		return (row->leaf->row[row->slot + 1]);
+	if (row->leaf->next)
+		return (row->leaf->next->row[0]);
+	return (NULL);
+}
+
+/* get previous row (NULL if first) */
+e_row *editor_row_prev(e_row *row) {
+	if (row->slot > 0)
+		return (row->leaf->row[row->slot - 1]);
+	if (row->leaf->prev)
+		return (row->leaf->prev->row[row->leaf->prev->n - 1]);
+	return (NULL);
+}
+
+/* insert row in the tree at index idx */
+void rtree_insert(long idx, e_row *row) {
+	struct rt_node *node;
+
+	/* empty tree, create first leaf */
+	if (!g_e.rows)
+		g_e.rows = rtree_new_node(1);
+
+	/* go down the tree to the leaf where idx is */
+	node = g_e.rows;
+	while (!node->is_leaf) {
+		int i = 0;
+		while (i < node->n - 1 && idx > node->child[i]->cnt) {
+			idx -= node->child[i]->cnt;
+			i++;
+		}
+		node = node->child[i];
+	}
+
+	/* split leaf if it is full and get the half where idx is now */
+	if (node->n == RT_CAP) {
+		rtree_split(node);
+		if (idx > node->n) {
+			idx -= node->n;
+			node = node->next;
+		}
+	}
+
+	/* insert row in leaf */
+	memmove(&node->row[idx + 1], &node->row[idx], sizeof(e_row *) * (node->n - idx));
+	node->row[idx] = row;
+	node->n++;
+	rtree_fix_slots(node, idx);
+	rtree_add_cnt(node, 1);
+}
+
+/* remove row at index idx from the tree (row is not freed) */
+void rtree_remove(long idx) {
+	e_row *row = editor_row_at(idx);
+	struct rt_node *leaf;
+
+	if (!row)
+		return;
+
+	/* remove row from leaf */
+	leaf = row->leaf;
+	memmove(&leaf->row[row->slot], &leaf->row[row->slot + 1], sizeof(e_row *) * (leaf->n - row->slot - 1));
+	leaf->n--;
+	rtree_fix_slots(leaf, row->slot);
+	rtree_add_cnt(leaf, -1);
+
+	/* remove empty leaf */
+	if (leaf->n == 0)
+		rtree_unlink(leaf);
+
+	/* remove root levels with only one child */
+	while (g_e.rows && !g_e.rows->is_leaf && g_e.rows->n == 1) {
+		struct rt_node *old = g_e.rows;
+		g_e.rows = old->child[0];
+		g_e.rows->parent = NULL;
+		rmem_free(old, sizeof(struct rt_node));
+	}
+}
+
+/* append a row to the tree being built */
+void rtree_build_append(struct rt_builder *b, e_row *row) {
+	/* start a new leaf when the last one is filled */
+	if (!b->last || b->last->n == RT_FILL) {
+		struct rt_node *leaf = rtree_new_node(1);
+		leaf->prev = b->last;
+		if (b->last)
+			b->last->next = leaf;
+		else
+			b->first = leaf;
+		b->last = leaf;
+		b->n_leaves++;
+	}
+
+	/* append row to the leaf */
+	b->last->row[b->last->n] = row;
+	row->leaf = b->last;
+	row->slot = b->last->n;
+	b->last->n++;
+	b->last->cnt++;
+}
+
+/* build the inner levels of the tree over the leaves and set it as the rows */
+void rtree_build_finish(struct rt_builder *b) {
+	struct rt_node **level;
+	struct rt_node *leaf;
+	long n = b->n_leaves;
+	long i;
+
+	/* nothing to build */
+	if (!n)
+		return;
+
+	/* get the leaves in an array */
+	level = (struct rt_node **)malloc(sizeof(struct rt_node *) * n);
+	if (!level)
+		die("malloc");
+	for (i = 0, leaf = b->first; leaf; leaf = leaf->next)
+		level[i++] = leaf;
+
+	/* group every RT_FILL nodes under a new parent until only the root is left */
+	while (n > 1) {
+		long n_parents = 0;
+		for (i = 0; i < n; i++) {
+			/* parents are stored in the same array (never past the child we read) */
+			struct rt_node *child = level[i];
+			if (i % RT_FILL == 0)
+				level[n_parents++] = rtree_new_node(0);
+			struct rt_node *parent = level[n_parents - 1];
+			rtree_insert_child(parent, parent->n, child);
+			parent->cnt += child->cnt;
+		}
+		n = n_parents;
+	}
+
+	/* set the tree (the buffer must be empty) */
+	g_e.rows = level[0];
+	free(level);
+}
+
+/* free all the rows (rows, their lines, render and hl and the tree nodes are all in the row memory) */
+void rtree_free() {
+	rmem_release();
+	g_e.rows = NULL;
+	g_e.n_rows = 0;
+
+	/* nothing points to the rows anymore */
+	g_e.gap_row = NULL;
+	g_e.match_row = NULL;
+	g_e.rc_head = NULL;
+	g_e.rc_tail = NULL;
+	g_e.rc_used = 0;
+}
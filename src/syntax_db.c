@@ -0,0 +1,316 @@
+#include <minivim.h>
+
+/*
+ * syntax definitions are loaded from *.syn files in the syntax directories
+ * (MINIVIM_SYNTAX, the user config directory and SYN_DIR, in that order, the
+ * first definition of a file type wins) and compiled into a lexer table when
+ * loaded, the built-in C syntax is used when no file defines it
+ *
+ * a definition file has one setting per line, lines starting with '#' are
+ * ignored:
+ *
+ *   name c
+ *   match .c .h Makefile      (extensions or parts of the file name)
+ *   comment //
+ *   mlcomment <!-- -->        (start and end)
+ *   string "'                 (quote chars)
+ *   escape \                  (escape char in strings)
+ *   numbers                   (hl numbers)
+ *   separators ,.()+-=<>[];   (chars that end words)
+ *   keyword if else while     (can be repeated)
+ *   type int char             (secondary keywords, can be repeated)
+ */
+
+/*** built-in filetypes ***/
+
+char *C_HL_extensions[] = { ".c", ".h", ".cpp", ".hpp", ".cc", NULL};
+
+char *C_HL_keywords[] = {
+	/* C Keywords */
+	"auto","break","case","continue","default","do","else","enum",
+	"extern","for","goto","if","register","return","sizeof","static",
+	"struct","switch","typedef","union","volatile","while","NULL",
+
+	/* C++ Keywords */
+	"alignas","alignof","and","and_eq","asm","bitand","bitor","class",
+	"compl","constexpr","const_cast","deltype","delete","dynamic_cast",
+	"explicit","export","false","friend","inline","mutable","namespace",
+	"new","noexcept","not","not_eq","nullptr","operator","or","or_eq",
+	"private","protected","public","reinterpret_cast","static_assert",
+	"static_cast","template","this","thread_local","throw","true","try",
+	"typeid","typename","virtual","xor","xor_eq",
+
+	/* C types */
+	"int|","long|","double|","float|","char|","unsigned|","signed|",
+	"void|","short|","auto|","const|","bool|",NULL
+};
+
+struct e_syntax HLDB[] = {
+	{
+		.f_type = "c",
+		.f_match = C_HL_extensions,
+		.keywords = C_HL_keywords,
+		.oneline_comment = "//",
+		.ml_comment_st = "/*",
+		.ml_comment_end = "*/",
+		.flags = HL_HL_NBR | HL_HL_STR,
+		.quotes = "\"'",
+		.escape = '\\',
+		.separators = HL_SEPARATORS
+	},
+};
+
+# define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+
+/* loaded syntaxes */
+static struct e_syntax **syn_db = NULL;
+static int syn_n = 0;
+
+/* growing list of strings (NULL terminated) */
+struct syn_list {
+	char **s;
+	int n;
+	int cap;
+};
+
+/* defaults of the settings of a loaded syntax (not copies, never freed) */
+static char syn_no_quotes[] = "";
+static char syn_separators[] = HL_SEPARATORS;
+
+/* copy a string */
+static char *syn_dup(const char *s) {
+	char *new = strdup(s);
+
+	if (!new)
+		die("strdup");
+
+	return (new);
+}
+
+/* append a copy of s (with suffix) to a list */
+static void syn_list_add(struct syn_list *l, const char *s, const char *suffix) {
+	if (l->n + 2 > l->cap) {
+		l->cap = l->cap ? l->cap * 2 : 16;
+		l->s = (char **)realloc(l->s, sizeof(char *) * l->cap);
+		if (!l->s)
+			die("realloc");
+	}
+
+	l->s[l->n] = (char *)malloc(strlen(s) + strlen(suffix) + 1);
+	if (!l->s[l->n])
+		die("malloc");
+	strcpy(l->s[l->n], s);
+	strcat(l->s[l->n], suffix);
+	l->n++;
+	l->s[l->n] = NULL;
+}
+
+/* return true if a syntax with that name is loaded */
+static int syn_db_has(const char *name) {
+	for (int i = 0; i < syn_n; i++) {
+		if (!strcmp(syn_db[i]->f_type, name))
+			return (1);
+	}
+	return (0);
+}
+
+/* compile a syntax and add it to the loaded syntaxes */
+static void syn_db_add(struct e_syntax *syn) {
+	editor_syntax_compile(syn);
+
+	syn_db = (struct e_syntax **)realloc(syn_db, sizeof(struct e_syntax *) * (syn_n + 1));
+	if (!syn_db)
+		die("realloc");
+	syn_db[syn_n++] = syn;
+}
+
+/* get a comment delimiter (NULL if there is none) */
+static char *syn_delim(const char *s) {
+	if (!s)
+		return (NULL);
+	return (syn_dup(s));
+}
+
+/* set a string setting (it can be repeated, the last one wins) */
+static void syn_set(char **dst, char *val) {
+	if (*dst != syn_no_quotes && *dst != syn_separators)
+		free(*dst);
+	*dst = val;
+}
+
+/* free a syntax that is being loaded and the strings it owns */
+static void syn_free(struct e_syntax *syn) {
+	syn_set(&syn->f_type, NULL);
+	syn_set(&syn->oneline_comment, NULL);
+	syn_set(&syn->ml_comment_st, NULL);
+	syn_set(&syn->ml_comment_end, NULL);
+	syn_set(&syn->quotes, NULL);
+	syn_set(&syn->separators, NULL);
+	free(syn);
+}
+
+/* load a syntax file, return -1 if it is not a valid definition */
+static int syn_load_file(const char *path) {
+	struct syn_list match = {NULL, 0, 0};
+	struct syn_list kw = {NULL, 0, 0};
+	struct e_syntax *syn;
+	char *line = NULL;
+	size_t line_cap = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return (-1);
+
+	syn = (struct e_syntax *)calloc(1, sizeof(struct e_syntax));
+	if (!syn)
+		die("calloc");
+	syn->quotes = syn_no_quotes;
+	syn->separators = syn_separators;
+
+	/* read one setting per line */
+	while (getline(&line, &line_cap, fp) != -1) {
+		char *key = strtok(line, " \t\r\n");
+		char *val;
+
+		/* empty line or comment */
+		if (!key || key[0] == '#')
+			continue;
+
+		val = strtok(NULL, " \t\r\n");
+		if (!strcmp(key, "name") && val) {
+			syn_set(&syn->f_type, syn_dup(val));
+		} else if (!strcmp(key, "match")) {
+			for (; val; val = strtok(NULL, " \t\r\n"))
+				syn_list_add(&match, val, "");
+		} else if (!strcmp(key, "keyword") || !strcmp(key, "type")) {
+			/* secondary keywords end with '|' */
+			for (; val; val = strtok(NULL, " \t\r\n"))
+				syn_list_add(&kw, val, key[0] == 't' ? "|" : "");
+		} else if (!strcmp(key, "comment")) {
+			syn_set(&syn->oneline_comment, syn_delim(val));
+		} else if (!strcmp(key, "mlcomment")) {
+			syn_set(&syn->ml_comment_st, syn_delim(val));
+			syn_set(&syn->ml_comment_end, syn_delim(strtok(NULL, " \t\r\n")));
+		} else if (!strcmp(key, "string") && val) {
+			syn_set(&syn->quotes, syn_dup(val));
+			syn->flags |= HL_HL_STR;
+		} else if (!strcmp(key, "escape")) {
+			syn->escape = val ? (unsigned char)val[0] : 0;
+		} else if (!strcmp(key, "numbers")) {
+			syn->flags |= HL_HL_NBR;
+		} else if (!strcmp(key, "separators") && val) {
+			syn_set(&syn->separators, syn_dup(val));
+		}
+	}
+	free(line);
+	fclose(fp);
+
+	/* a definition needs a name and something to match (first one wins) */
+	if (!syn->f_type || !match.n || syn_db_has(syn->f_type)) {
+		for (int i = 0; i < match.n; i++)
+			free(match.s[i]);
+		for (int i = 0; i < kw.n; i++)
+			free(kw.s[i]);
+		free(match.s);
+		free(kw.s);
+		syn_free(syn);
+		return (-1);
+	}
+
+	/* multiline comments need both delimiters */
+	if (!syn->ml_comment_st || !syn->ml_comment_end) {
+		syn_set(&syn->ml_comment_st, NULL);
+		syn_set(&syn->ml_comment_end, NULL);
+	}
+
+	syn->f_match = match.s;
+	/* keyword list can not be NULL */
+	if (!kw.s)
+		syn_list_add(&kw, "", "");
+	syn->keywords = kw.s;
+
+	syn_db_add(syn);
+
+	return (0);
+}
+
+/* only load syntax files */
+static int syn_filter(const struct dirent *ent) {
+	size_t len = strlen(ent->d_name);
+
+	return (len > 4 && !strcmp(&ent->d_name[len - 4], ".syn"));
+}
+
+/* load all the syntax files of a directory (in name order) */
+static void syn_load_dir(const char *dir) {
+	struct dirent **ents;
+	char path[PATH_MAX];
+	int n;
+
+	n = scandir(dir, &ents, syn_filter, alphasort);
+	if (n < 0)
+		return;
+
+	for (int i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, ents[i]->d_name);
+		syn_load_file(path);
+		free(ents[i]);
+	}
+	free(ents);
+}
+
+/* load the syntaxes (only the first time) */
+static void syn_db_load() {
+	static int loaded = 0;
+	char path[PATH_MAX];
+	char *env;
+
+	if (loaded)
+		return;
+	loaded = 1;
+
+	/* directory set by the user */
+	if ((env = getenv("MINIVIM_SYNTAX")))
+		syn_load_dir(env);
+
+	/* user config directory */
+	if ((env = getenv("XDG_CONFIG_HOME")) && env[0]) {
+		snprintf(path, sizeof(path), "%s/minivim/syntax", env);
+		syn_load_dir(path);
+	} else if ((env = getenv("HOME"))) {
+		snprintf(path, sizeof(path), "%s/.config/minivim/syntax", env);
+		syn_load_dir(path);
+	}
+
+	/* system directory */
+	syn_load_dir(SYN_DIR);
+
+	/* built-in syntaxes (if not defined in a file) */
+	for (unsigned int i = 0; i < HLDB_ENTRIES; i++) {
+		if (!syn_db_has(HLDB[i].f_type))
+			syn_db_add(&HLDB[i]);
+	}
+}
+
+/* get the syntax of a file name (NULL if there is none) */
+struct e_syntax *syntax_db_match(const char *filename) {
+	/* get last '.' in string */
+	char *ext = strrchr(filename, '.');
+
+	syn_db_load();
+
+	/* loop loaded syntaxes */
+	for (int i = 0; i < syn_n; i++) {
+		struct e_syntax *s = syn_db[i];
+		/* loop every pattern */
+		for (int j = 0; s->f_match[j]; j++) {
+			int is_ext = (s->f_match[j][0] == '.');
+			/* check if match pattern */
+			if ((is_ext && ext && !strcmp(ext, s->f_match[j])) || (!is_ext && strstr(filename, s->f_match[j])))
+				return (s);
+		}
+	}
+
+	return (NULL);
+}
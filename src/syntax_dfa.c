@@ -0,0 +1,216 @@
+#include <minivim.h>
+
+/*
+ * a syntax is compiled into a DFA: every byte is mapped to a byte class and
+ * every (state, class) pair has a transition with the next state, the hl of
+ * the byte, if a keyword can start at the byte and if a comment delimiter can
+ * start (or end) at the byte, so the lexer is a single table walk per row that
+ * only compares bytes with the delimiters where they can be
+ *
+ * the states are found by running the lexer rules on every byte from the start
+ * states until no new states appear, then bytes that behave the same in every
+ * state are merged in the same class
+ */
+
+/* lexer context of a state */
+enum hl_ctx {
+	CTX_SEP = 0,
+	CTX_WORD,
+	CTX_NUM,
+	CTX_STR,
+	CTX_ESC,
+	CTX_COMMENT,
+	CTX_MLCOMMENT
+};
+
+/* lexer state (before compiling it) */
+struct hl_state {
+	int ctx;
+	/* quote char of the string */
+	int quote;
+};
+
+/* states found so far */
+struct hl_states {
+	struct hl_state *st;
+	int n;
+	int cap;
+};
+
+/* get id of a state, add it if it is new */
+static int hl_state_id(struct hl_states *sts, struct hl_state *st) {
+	int i;
+
+	for (i = 0; i < sts->n; i++) {
+		if (sts->st[i].ctx == st->ctx && sts->st[i].quote == st->quote)
+			return (i);
+	}
+
+	/* new state */
+	if (sts->n == sts->cap) {
+		sts->cap = sts->cap ? sts->cap * 2 : 16;
+		sts->st = (struct hl_state *)realloc(sts->st, sizeof(struct hl_state) * sts->cap);
+		if (!sts->st)
+			die("realloc");
+	}
+	sts->st[sts->n] = *st;
+
+	return (sts->n++);
+}
+
+/* run the lexer rules on byte c from state st */
+static void hl_step(struct e_syntax *syn, struct hl_state *st, int c, struct hl_state *next, struct hl_trans *t) {
+	memset(next, 0, sizeof(struct hl_state));
+	memset(t, 0, sizeof(struct hl_trans));
+
+	/* one line comment until end of line */
+	if (st->ctx == CTX_COMMENT) {
+		next->ctx = CTX_COMMENT;
+		t->hl = HL_COMMENT;
+		return;
+	}
+
+	/* escaped char in a string */
+	if (st->ctx == CTX_ESC) {
+		next->ctx = CTX_STR;
+		next->quote = st->quote;
+		t->hl = HL_STRING;
+		return;
+	}
+
+	/* string until the quote char (prev_sep after it) */
+	if (st->ctx == CTX_STR) {
+		if (syn->escape && c == syn->escape) {
+			next->ctx = CTX_ESC;
+			next->quote = st->quote;
+		} else if (c == st->quote) {
+			next->ctx = CTX_SEP;
+		} else {
+			next->ctx = CTX_STR;
+			next->quote = st->quote;
+		}
+		t->hl = HL_STRING;
+		return;
+	}
+
+	/* multiline comment until its end */
+	if (st->ctx == CTX_MLCOMMENT) {
+		next->ctx = CTX_MLCOMMENT;
+		t->hl = HL_MLCOMMENT;
+		t->delim = (syn->ml_comment_end && c == (unsigned char)syn->ml_comment_end[0]) ? HL_DELIM_END : 0;
+		return;
+	}
+
+	/* a comment can start here (checked before anything else) */
+	if ((syn->oneline_comment && c == (unsigned char)syn->oneline_comment[0])
+		|| (syn->ml_comment_end && c == (unsigned char)syn->ml_comment_st[0]))
+		t->delim = HL_DELIM_START;
+
+	/* string starts */
+	if ((syn->flags & HL_HL_STR) && c && strchr(syn->quotes, c)) {
+		next->ctx = CTX_STR;
+		next->quote = c;
+		t->hl = HL_STRING;
+		return;
+	}
+
+	/* numbers (after a separator or in a number) */
+	if ((syn->flags & HL_HL_NBR) && ((isdigit(c) && (st->ctx == CTX_SEP || st->ctx == CTX_NUM))
+		|| (c == '.' && st->ctx == CTX_NUM))) {
+		next->ctx = CTX_NUM;
+		t->hl = HL_NUMBER;
+		return;
+	}
+
+	/* anything else, a keyword can start after a separator */
+	t->kw = (st->ctx == CTX_SEP && !syn->dfa.sep[c] && syn->kw_n > 0);
+	next->ctx = syn->dfa.sep[c] ? CTX_SEP : CTX_WORD;
+	t->hl = HL_NORMAL;
+}
+
+/* compile syntax into a DFA */
+void hl_dfa_compile(struct e_syntax *syn) {
+	struct hl_states sts = {NULL, 0, 0};
+	struct hl_state st;
+	struct hl_trans *full = NULL;
+	int cap = 0;
+	int s;
+	int c;
+
+	/* already compiled */
+	if (syn->dfa.trans)
+		return;
+
+	/* separator table */
+	for (c = 0; c < 256; c++)
+		syn->dfa.sep[c] = (isspace(c) || c == '\0' || strchr(syn->separators, c) != NULL);
+
+	/* comment delimiters */
+	syn->dfa.olc_l = syn->oneline_comment ? strlen(syn->oneline_comment) : 0;
+	syn->dfa.mlcs_l = syn->ml_comment_end ? strlen(syn->ml_comment_st) : 0;
+	syn->dfa.mlce_l = syn->ml_comment_end ? strlen(syn->ml_comment_end) : 0;
+
+	/* start states (out of a multiline comment or in one), state after a keyword and one line comment */
+	memset(&st, 0, sizeof(st));
+	st.ctx = CTX_SEP;
+	syn->dfa.start[0] = hl_state_id(&sts, &st);
+	st.ctx = CTX_MLCOMMENT;
+	syn->dfa.start[1] = hl_state_id(&sts, &st);
+	st.ctx = CTX_WORD;
+	syn->dfa.word = hl_state_id(&sts, &st);
+	st.ctx = CTX_COMMENT;
+	syn->dfa.comment = hl_state_id(&sts, &st);
+
+	/* get the transitions of every state on every byte (new states are added at the end) */
+	for (s = 0; s < sts.n; s++) {
+		if (sts.n > cap) {
+			cap = sts.cap;
+			full = (struct hl_trans *)realloc(full, sizeof(struct hl_trans) * 256 * cap);
+			if (!full)
+				die("realloc");
+		}
+		for (c = 0; c < 256; c++) {
+			struct hl_state cur = sts.st[s];
+			struct hl_state next;
+			struct hl_trans *t = &full[s * 256 + c];
+			hl_step(syn, &cur, c, &next, t);
+			t->next = hl_state_id(&sts, &next);
+		}
+		if (sts.n > HL_STATES_MAX)
+			die("syntax: too many states");
+	}
+	syn->dfa.n_states = sts.n;
+
+	/* merge bytes with the same transitions in every state into byte classes */
+	int rep[256];
+	syn->dfa.n_cls = 0;
+	for (c = 0; c < 256; c++) {
+		int k;
+		for (k = 0; k < syn->dfa.n_cls; k++) {
+			for (s = 0; s < sts.n; s++) {
+				if (memcmp(&full[s * 256 + c], &full[s * 256 + rep[k]], sizeof(struct hl_trans)))
+					break;
+			}
+			if (s == sts.n)
+				break;
+		}
+		if (k == syn->dfa.n_cls)
+			rep[syn->dfa.n_cls++] = c;
+		syn->dfa.cls[c] = k;
+	}
+
+	/* build the final table (states x classes) */
+	syn->dfa.trans = (struct hl_trans *)malloc(sizeof(struct hl_trans) * sts.n * syn->dfa.n_cls);
+	syn->dfa.persist = (unsigned char *)malloc(sts.n);
+	if (!syn->dfa.trans || !syn->dfa.persist)
+		die("malloc");
+	for (s = 0; s < sts.n; s++) {
+		for (int k = 0; k < syn->dfa.n_cls; k++)
+			syn->dfa.trans[s * syn->dfa.n_cls + k] = full[s * 256 + rep[k]];
+		/* only multiline comments go on in the next row */
+		syn->dfa.persist[s] = (sts.st[s].ctx == CTX_MLCOMMENT);
+	}
+
+	free(full);
+	free(sts.st);
+}
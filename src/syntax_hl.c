@@ -1,198 +1,549 @@
 #include <minivim.h>
 
-/*** filetypes ***/
-
-char *C_HL_extensions[C_HL_EXT_SIZE] = { ".c", ".h", ".cpp", ".hpp", ".cc", NULL};
-
-char *C_HL_keywords[C_HL_KEYW_SIZE] = {
-	/* C Keywords */
-	"auto","break","case","continue","default","do","else","enum",
-	"extern","for","goto","if","register","return","sizeof","static",
-	"struct","switch","typedef","union","volatile","while","NULL",
-
-	/* C++ Keywords */
-	"alignas","alignof","and","and_eq","asm","bitand","bitor","class",
-	"compl","constexpr","const_cast","deltype","delete","dynamic_cast",
-	"explicit","export","false","friend","inline","mutable","namespace",
-	"new","noexcept","not","not_eq","nullptr","operator","or","or_eq",
-	"private","protected","public","reinterpret_cast","static_assert",
-	"static_cast","template","this","thread_local","throw","true","try",
-	"typeid","typename","virtual","xor","xor_eq",
-
-	/* C types */
-	"int|","long|","double|","float|","char|","unsigned|","signed|",
-	"void|","short|","auto|","const|","bool|",NULL
-};
+/* hash a word with a seed (FNV-1a) */
+static unsigned int hl_kw_hash(const char *s, long len, unsigned int seed) {
+	unsigned int h = 2166136261u ^ seed;
 
-struct e_syntax HLDB[HLDB_SIZE] = {
-	{
-		"c",
-		C_HL_extensions,
-		C_HL_keywords,
-		"//", "/*", "*/",
-		HL_HL_NBR | HL_HL_STR
-	},
-};
+	for (long i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619u;
+
+	return (h ^ (h >> 16));
+}
 
-# define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+/* try to place all keywords in the table with a seed, return -1 on collision */
+static int hl_kw_place(struct e_syntax *syn, unsigned int seed) {
+	memset(syn->kw_slot, 0, sizeof(unsigned short) * (syn->kw_mask + 1));
+	for (int i = 0; i < syn->kw_n; i++) {
+		unsigned int h = hl_kw_hash(syn->kw_list[i].kw, syn->kw_list[i].len, seed) & syn->kw_mask;
+		if (syn->kw_slot[h])
+			return (-1);
+		syn->kw_slot[h] = i + 1;
+	}
+	syn->kw_seed = seed;
 
-/* return true if char is a separator */
-int is_separator(int c) {
-	return (isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL);
+	return (0);
 }
 
-/* set row syntax */
-void editor_update_syntax(e_row *row) {
-	/* realloc memory por hl array */
-	row->hl = (unsigned char *)realloc(row->hl, row->r_sz);
-	/* set all array to normal hl */
-	memset(row->hl, HL_NORMAL, row->r_sz);
+/* compile keywords of a syntax into a perfect hash table (len and hl class are decided here) */
+static void hl_kw_compile(struct e_syntax *syn) {
+	int n = 0;
+	int i;
 
-	/* not update syntax if no fily type is detected */
-	if (g_e.syntax == NULL) return;
+	/* already compiled */
+	if (syn->kw_slot)
+		return;
 
-	/* keywords alias */
-	char **keywords = g_e.syntax->keywords;
-
-	/* initialise comment */
-	char *olc = g_e.syntax->oneline_comment;
-	char *mlcs = g_e.syntax->ml_comment_st;
-	char *mlce = g_e.syntax->ml_comment_end;
-
-	/* check if active comment */
-	int olc_l = olc ? strlen(olc) : 0;
-	int mlcs_l = mlcs ? strlen(mlcs) : 0;
-	int mlce_l = mlce ? strlen(mlce) : 0;
-
-	/* save if previus character was a separator (def: 1) */
-	int prev_sep = 1;
-	/* save if we are in a string (def: 0) */
-	int in_str = 0;
-	/* check if previus lines was a multiline comment with no end */
-	int in_comment = (row->idx > 0 && g_e.row[row->idx - 1].hl_open_comment);
-
-	int i = 0;
-	while (i < row->r_sz) {
-		/* get current char */
-		char c = row->rend[i];
-		/* get previus hl */
-		unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
-
-		/* hl one line comment */
-		if (olc_l && !in_str && !in_comment) {
-			if (!strncmp(&row->rend[i], olc, olc_l)) {
-				memset(&row->hl[i], HL_COMMENT, row->r_sz - i);
+	/* count keywords and allocate list */
+	while (syn->keywords[n])
+		n++;
+	syn->kw_list = (struct hl_kw *)malloc(sizeof(struct hl_kw) * (n + 1));
+	if (!syn->kw_list)
+		die("malloc");
+
+	/* get len and hl class of every keyword (secondary keywords end with '|') */
+	syn->kw_n = 0;
+	syn->kw_max = 0;
+	for (i = 0; i < n; i++) {
+		struct hl_kw kw;
+		kw.kw = syn->keywords[i];
+		kw.len = strlen(kw.kw);
+		kw.hl = HL_KEYWORD1;
+		if (kw.len > 0 && kw.kw[kw.len - 1] == '|') {
+			kw.len--;
+			kw.hl = HL_KEYWORD2;
+		}
+		/* skip empty and repeated keywords (first one wins) */
+		int j;
+		for (j = 0; j < syn->kw_n; j++) {
+			if (syn->kw_list[j].len == kw.len && !strncmp(syn->kw_list[j].kw, kw.kw, kw.len))
 				break;
-			}
 		}
+		if (kw.len == 0 || j < syn->kw_n)
+			continue;
+		if (kw.len > syn->kw_max)
+			syn->kw_max = kw.len;
+		syn->kw_list[syn->kw_n++] = kw;
+	}
 
-		/* hl multi line comments */
-		if (mlcs_l && mlce_l && !in_str) {
-			/* if we are in a comment, comment until multicomment end */
-			if (in_comment) {
-				row->hl[i] = HL_MLCOMMENT;
-				if (!strncmp(&row->rend[i], mlce, mlce_l)) {
-					memset(&row->hl[i], HL_MLCOMMENT, mlce_l);
-					i += mlce_l;
-					in_comment = 0;
-					prev_sep = 1;
-					continue;
-				} else {
-					i++;
-					continue;
-				}
-			/* else check if multicomment starts */
-			} else if (!strncmp(&row->rend[i], mlcs, mlcs_l)) {
-				memset(&row->hl[i], HL_MLCOMMENT, mlcs_l);
-				i += mlcs_l;
-				in_comment = 1;
-				continue;
-			}
+	/* find a seed with no collisions, make the table bigger if it is hard to find one */
+	unsigned int sz = 4;
+	while (sz < (unsigned int)syn->kw_n * 8)
+		sz <<= 1;
+	while (1) {
+		syn->kw_mask = sz - 1;
+		syn->kw_slot = (unsigned short *)malloc(sizeof(unsigned short) * sz);
+		if (!syn->kw_slot)
+			die("malloc");
+		for (unsigned int seed = 1; seed <= 1024; seed++) {
+			if (hl_kw_place(syn, seed) == 0)
+				return;
+		}
+		free(syn->kw_slot);
+		sz <<= 1;
+	}
+}
+
+/* get hl class of a word if it is a keyword (HL_NORMAL if not) */
+static int hl_kw_find(struct e_syntax *syn, const char *s, long len) {
+	if (len == 0 || len > syn->kw_max)
+		return (HL_NORMAL);
+
+	/* only one keyword can be in the slot */
+	int i = syn->kw_slot[hl_kw_hash(s, len, syn->kw_seed) & syn->kw_mask];
+	if (!i)
+		return (HL_NORMAL);
+	i--;
+	if (syn->kw_list[i].len != len || memcmp(syn->kw_list[i].kw, s, len))
+		return (HL_NORMAL);
+
+	return (syn->kw_list[i].hl);
+}
+
+/* compile keywords and lexer table of a syntax */
+void editor_syntax_compile(struct e_syntax *syn) {
+	hl_kw_compile(syn);
+	hl_dfa_compile(syn);
+}
+
+/* add a run of len chars from st with hl class cls to the spans (normal chars are not stored) */
+static void hl_spans_add(struct hl_spans *out, long st, long len, int cls) {
+	struct hl_span *last = out->n ? &out->s[out->n - 1] : NULL;
+
+	if (cls == HL_NORMAL || len <= 0)
+		return;
+
+	/* extend last span */
+	if (last && last->hl == cls && last->st + last->len == st && last->len + len <= HL_SPAN_MAX) {
+		last->len += (unsigned short)len;
+		return;
+	}
+
+	/* add new spans (split long runs) */
+	while (len > 0) {
+		long l = (len > HL_SPAN_MAX) ? HL_SPAN_MAX : len;
+		if (out->n == out->cap) {
+			out->cap = out->cap ? out->cap * 2 : 16;
+			out->s = (struct hl_span *)realloc(out->s, sizeof(struct hl_span) * out->cap);
+			if (!out->s)
+				die("realloc");
 		}
+		out->s[out->n].st = st;
+		out->s[out->n].len = (unsigned short)l;
+		out->s[out->n].hl = cls;
+		out->n++;
+		st += l;
+		len -= l;
+	}
+}
+
+/*
+ * point where a re-lex of a changed render can stop: from new position min
+ * on, the chars are the old ones shifted by delta, a plain char (normal hl)
+ * leaves the lexer after a separator or in a word, so when the old hl had a
+ * plain char before the same position and the lexer is in the same state
+ * there, the rest of the hl is the same as before
+ */
+struct hl_conv {
+	long min;
+	/* old spans after the change (they start relative to end) and first one that can be after the position */
+	long end;
+	const struct hl_span *old;
+	int old_n;
+	int j;
+	/* position where the lexer stopped (-1 if it got to the end) */
+	long at;
+};
+
+/* return true if the old hl has a plain char before new position i */
+static int hl_conv_old(struct hl_conv *cv, long i) {
+	long o = i - cv->end - 1;
 
-		/* hl strings */
-		if (g_e.syntax->flags & HL_HL_STR) {
-			/* if we already are in a str */
-			if (in_str) {
-				/* change hl */
-				row->hl[i] = HL_STRING;
-				/* if we find \ skip two chars just in case the second is a " or ' */
-				if (c == '\\' && i + 1 < row->r_sz) {
-					row->hl[i + 1] = HL_STRING;
-					i += 2;
-					continue;
+	while (cv->j < cv->old_n && cv->old[cv->j].st + cv->old[cv->j].len <= o)
+		cv->j++;
+
+	return (cv->j == cv->old_n || cv->old[cv->j].st > o);
+}
+
+/*
+ * hl chars of s from position from to len with a syntax starting with DFA
+ * state st into spans (out can be NULL to get only the state), stop where
+ * the state converges if cv is not NULL, return the DFA state at the end
+ * (thread safe)
+ */
+static int hl_lex(struct e_syntax *syn, const char *s, long len, long from, int st, struct hl_spans *out, struct hl_conv *cv) {
+	const struct hl_dfa *dfa = &syn->dfa;
+	const char *olc = syn->oneline_comment;
+	const char *mlcs = syn->ml_comment_st;
+	const char *mlce = syn->ml_comment_end;
+	/* run of chars with the same hl being built */
+	long run_st = from;
+	int run_hl = HL_NORMAL;
+
+	/* one transition per byte */
+	for (long i = from; i < len; i++) {
+		const struct hl_trans *t = &dfa->trans[st * dfa->n_cls + dfa->cls[(unsigned char)s[i]]];
+
+		/* state is the same as before the change */
+		if (cv && i >= cv->min && st == (dfa->sep[(unsigned char)s[i - 1]] ? dfa->start[0] : dfa->word)
+			&& hl_conv_old(cv, i)) {
+			if (out)
+				hl_spans_add(out, run_st, i - run_st, run_hl);
+			cv->at = i;
+			return (st);
+		}
+
+		/* a comment can start here (one line comments first) */
+		if (t->delim == HL_DELIM_START) {
+			if (dfa->olc_l && i + dfa->olc_l <= len && !memcmp(&s[i], olc, dfa->olc_l)) {
+				if (out) {
+					hl_spans_add(out, run_st, i - run_st, run_hl);
+					hl_spans_add(out, i, len - i, HL_COMMENT);
 				}
-				/* if we find " or ' again set in_str to 0 (we are out of the str) */
-				if (c == in_str) in_str = 0;
-				/* set prev_sep to true and continue looping */
-				i++;
-				prev_sep = 1;
-				continue;
-			/* if we are not in a str */
-			} else {
-				/* if we find a start str character */
-				if (c == '"' || c == '\'') {
-					/* set in_str to the char (" or ') */
-					in_str = c;
-					/* change hl */
-					row->hl[i] = HL_STRING;
-					/* continue looping */
-					i++;
-					continue;
+				run_st = len;
+				st = dfa->comment;
+				break;
+			}
+			if (dfa->mlcs_l && i + dfa->mlcs_l <= len && !memcmp(&s[i], mlcs, dfa->mlcs_l)) {
+				if (run_hl != HL_MLCOMMENT) {
+					if (out)
+						hl_spans_add(out, run_st, i - run_st, run_hl);
+					run_st = i;
+					run_hl = HL_MLCOMMENT;
 				}
+				i += dfa->mlcs_l - 1;
+				st = dfa->start[1];
+				continue;
 			}
-		}
-
-		/* hl numbers */
-		if (g_e.syntax->flags & HL_HL_NBR) {
-			if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) || (c == '.' && prev_hl == HL_NUMBER)) {
-				row->hl[i] = HL_NUMBER;
-				i++;
-				prev_sep = 0;
+		/* multiline comment can end here (prev_sep after it) */
+		} else if (t->delim == HL_DELIM_END) {
+			if (i + dfa->mlce_l <= len && !memcmp(&s[i], mlce, dfa->mlce_l)) {
+				/* row can start with it */
+				if (run_hl != HL_MLCOMMENT) {
+					if (out)
+						hl_spans_add(out, run_st, i - run_st, run_hl);
+					run_st = i;
+					run_hl = HL_MLCOMMENT;
+				}
+				i += dfa->mlce_l - 1;
+				st = dfa->start[0];
 				continue;
 			}
 		}
 
-		/* hl keywords */
-		/* check is preceeded by separator */
-		if (prev_sep) {
-			int j;
-			/* loop keywords and check */
-			for (j = 0; keywords[j]; j++) {
-				/* get len of keyword */
-				int k_len = strlen(keywords[j]);
-				/* get if it is a secondary keyword '|' (and remove '|' from k_len if so) */
-				int kw2 = keywords[j][k_len - 1] == '|';
-				if (kw2) k_len--;
-
-				/* check if it is a keyword and ends in separator */
-				if (!strncmp(&row->rend[i], keywords[j], k_len) && is_separator(row->rend[i + k_len])) {
-					/* hl keyword and increase i*/
-					memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, k_len);
-					i += k_len;
-					/* break for */
-					break;
+		/* word after a separator, check if it is a keyword (one lookup in the hash table) */
+		if (t->kw) {
+			long k_len = 1;
+			while (i + k_len < len && !dfa->sep[(unsigned char)s[i + k_len]])
+				k_len++;
+			int kw = hl_kw_find(syn, &s[i], k_len);
+			if (kw != HL_NORMAL) {
+				if (out) {
+					hl_spans_add(out, run_st, i - run_st, run_hl);
+					hl_spans_add(out, i, k_len, kw);
 				}
-			}
-			/* check if for was broken (or forced) out by checking the terminating NULL value */
-			if (keywords[j] != NULL) {
-				prev_sep = 0;
+				run_st = i + k_len;
+				run_hl = HL_NORMAL;
+				i += k_len - 1;
+				st = dfa->word;
 				continue;
 			}
 		}
 
-		/* set prev_sep */
-		prev_sep = is_separator(c);
+		/* hl byte (start a new run if the hl changes) */
+		if (t->hl != run_hl) {
+			if (out)
+				hl_spans_add(out, run_st, i - run_st, run_hl);
+			run_st = i;
+			run_hl = t->hl;
+		}
+		st = t->next;
+	}
+
+	/* last run */
+	if (out)
+		hl_spans_add(out, run_st, len - run_st, run_hl);
+
+	return (st);
+}
+
+/*
+ * hl len chars of s with a syntax starting with in_comment state into spans
+ * (out can be NULL to get only the state), return the state at the end
+ * (thread safe)
+ */
+int editor_syntax_lex(struct e_syntax *syn, const char *s, long len, struct hl_spans *out, int in_comment) {
+	if (out)
+		out->n = 0;
+
+	/* not update syntax if no fily type is detected */
+	if (syn == NULL)
+		return (0);
+
+	/* return multiline comment state */
+	return (syn->dfa.persist[hl_lex(syn, s, len, 0, syn->dfa.start[in_comment], out, NULL)]);
+}
+
+/*
+ * every row keeps the multiline comment state at its start and its end (a
+ * checkpoint), tagged with the syntax generation it was made with (0 when the
+ * row is edited), rows before the watermark (hl_upto) have a known state, the
+ * rest are checked by the syntax worker (see syntax_worker.c), a row is only
+ * lexed here when the state at its start is known, so a keystroke never lexes
+ * more than the rows on the screen
+ */
+
+/* set row syntax (render must be built) */
+void editor_update_syntax(e_row *row) {
+	static struct hl_spans spans = {NULL, 0, 0};
+	struct row_rend *rc = row->rc;
+	long idx = editor_row_idx(row);
+	int in_comment;
+
+	/* state at the start of the row is not known yet (the worker is on it) */
+	if (idx > g_e.hl_upto) {
+		/* keep hl the row already has (most of the times it is still right) */
+		if (rc->hl)
+			return;
+		/* draw it plain until the worker gets there */
+		rc->hl = (struct hl_span *)rmem_alloc(HL_SZ(0));
+		rc->hl_n = 0;
+		rc->hl_gap = 0;
+		rc->hl_gap_l = 0;
+		row->hl_gen = 0;
+		row->ver = ++g_e.row_ver;
+		return;
+	}
+
+	/* get state at the end of the previous row */
+	in_comment = (idx > 0) ? editor_row_prev(row)->hl_open_comment : 0;
+
+	/* hl is up to date */
+	if (!(rc->hl && row->hl_gen == g_e.hl_gen && row->hl_in == in_comment)) {
+		/* hl row and set value of hl_open_comment to in_comment state at the end (too long rows are plain) */
+		if (HL_PLAIN(row->sz)) {
+			spans.n = 0;
+			row->hl_open_comment = in_comment;
+		} else {
+			row->hl_open_comment = editor_syntax_lex(g_e.syntax, editor_rend_from(rc, 0), rc->r_sz, &spans, in_comment);
+		}
+		row->hl_in = in_comment;
+		row->hl_gen = g_e.hl_gen;
+
+		/* keep only the spans the row has (at least one so hl is not NULL) */
+		rc->hl = (struct hl_span *)rmem_realloc(rc->hl, RC_HL_SZ(rc), HL_SZ(spans.n));
+		if (spans.n)
+			memcpy(rc->hl, spans.s, sizeof(struct hl_span) * spans.n);
+		rc->hl_n = spans.n;
+		rc->hl_gap = spans.n;
+		rc->hl_gap_l = 0;
+		row->ver = ++g_e.row_ver;
+	}
+
+	/* the state of this row is known now */
+	if (idx == g_e.hl_upto)
+		g_e.hl_upto++;
+}
+
+/*
+ * the hl of the row being edited has a gap at the last change, the spans
+ * after it start relative to the end of the render, so they move with it when
+ * the render grows or shrinks and a change only rewrites the spans around it
+ */
+
+/* start of span i of a render whose spans after the gap start relative to end */
+static long hl_st(struct row_rend *rc, int i, long end) {
+	return ((i < rc->hl_gap) ? rc->hl[i].st : rc->hl[i + rc->hl_gap_l].st + end);
+}
+
+/* move the gap of the hl of a render before span k (end is the end of the render the spans after the gap start from) */
+static void hl_gap_move(struct row_rend *rc, int k, long end) {
+	for (; rc->hl_gap > k; rc->hl_gap--) {
+		struct hl_span *sp = &rc->hl[rc->hl_gap - 1 + rc->hl_gap_l];
+		*sp = rc->hl[rc->hl_gap - 1];
+		sp->st -= end;
+	}
+	for (; rc->hl_gap < k; rc->hl_gap++) {
+		struct hl_span *sp = &rc->hl[rc->hl_gap];
+		*sp = rc->hl[rc->hl_gap + rc->hl_gap_l];
+		sp->st += end;
+	}
+}
+
+/* make room for n spans in the gap of the hl of a render (the spans after it go to the end) */
+static void hl_gap_grow(struct row_rend *rc, int n) {
+	int gap_l = n + rc->hl_n / 2;
+
+	if (rc->hl_gap_l >= n)
+		return;
+	rc->hl = (struct hl_span *)rmem_realloc(rc->hl, RC_HL_SZ(rc), HL_SZ(rc->hl_n + gap_l));
+	memmove(&rc->hl[rc->hl_gap + gap_l], &rc->hl[rc->hl_gap + rc->hl_gap_l], sizeof(struct hl_span) * (rc->hl_n - rc->hl_gap));
+	rc->hl_gap_l = gap_l;
+}
+
+/* make the hl of a render flat again (close its gap) */
+void editor_syntax_flat(struct row_rend *rc) {
+	if (!rc->hl)
+		return;
+	hl_gap_move(rc, rc->hl_n, rc->r_sz);
+	if (rc->hl_gap_l) {
+		rc->hl = (struct hl_span *)rmem_realloc(rc->hl, RC_HL_SZ(rc), HL_SZ(rc->hl_n));
+		rc->hl_gap_l = 0;
+	}
+}
+
+/*
+ * the render of a row changed in place: the chars from rx to new_end are new
+ * and the ones after them are the old ones shifted by delta, re-lex from the
+ * last plain char before the change (far enough so no comment delimiter goes
+ * over it, and out of the word unless it is too long to be a keyword) until
+ * the state is the same as before and put the new spans in the gap instead of
+ * the old ones up to that point, return 0 if the hl can not be patched (it
+ * has to be built again)
+ */
+int editor_syntax_patch(e_row *row, long rx, long new_end, long delta) {
+	static struct hl_spans spans = {NULL, 0, 0};
+	struct e_syntax *syn = g_e.syntax;
+	struct row_rend *rc = row->rc;
+	/* end of the render before the change */
+	long end = rc->r_sz - delta;
+	struct hl_conv cv;
+	long p;
+	int j;
+	int st;
+
+	/* there is no hl or it is old (or the row is too long to be highlighted) */
+	if (!rc->hl || row->hl_gen != g_e.hl_gen || HL_PLAIN(row->sz))
+		return (0);
+	/* no syntax, hl is empty */
+	if (syn == NULL)
+		return (1);
 
-		i++;
+	/* start before any comment delimiter that can get to the change */
+	int dl = 1;
+	if (syn->dfa.olc_l > dl) dl = syn->dfa.olc_l;
+	if (syn->dfa.mlcs_l > dl) dl = syn->dfa.mlcs_l;
+	if (syn->dfa.mlce_l > dl) dl = syn->dfa.mlce_l;
+	p = (rx - dl + 1 > 0) ? rx - dl + 1 : 0;
+
+	/* first span that starts at or after p (binary search) */
+	int lo = 0;
+	int hi = rc->hl_n;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (hl_st(rc, mid, end) < p)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	j = lo;
+
+	/* go back to a plain separator, a plain char of a long word or the start of the row */
+	while (p > 0) {
+		while (j > 0 && hl_st(rc, j - 1, end) >= p)
+			j--;
+		if (j > 0 && hl_st(rc, j - 1, end) + HL_SPAN(rc, j - 1).len >= p)
+			p = hl_st(rc, j - 1, end);
+		else if (syn->dfa.sep[(unsigned char)REND_CH(rc, p - 1)] || rx - p >= syn->kw_max)
+			break;
+		else
+			p--;
+	}
+	while (j > 0 && hl_st(rc, j - 1, end) >= p)
+		j--;
+	if (p == 0)
+		st = syn->dfa.start[row->hl_in];
+	else
+		st = syn->dfa.sep[(unsigned char)REND_CH(rc, p - 1)] ? syn->dfa.start[0] : syn->dfa.word;
+
+	/* the old spans from j on go after the gap (they are in new positions now) */
+	hl_gap_move(rc, j, end);
+
+	/* re-lex until the state converges (the render from p on is in one piece) */
+	cv.min = new_end + 1;
+	cv.end = rc->r_sz;
+	cv.old = &rc->hl[j + rc->hl_gap_l];
+	cv.old_n = rc->hl_n - j;
+	cv.j = 0;
+	cv.at = -1;
+	spans.n = 0;
+	st = hl_lex(syn, editor_rend_from(rc, p), rc->r_sz, p, st, &spans, &cv);
+
+	/* the gap takes the old spans up to the point it stopped (all of them if it got to the end) and gives room to the new ones */
+	int drop = (cv.at == -1) ? cv.old_n : cv.j;
+	rc->hl_gap_l += drop;
+	rc->hl_n -= drop;
+	hl_gap_grow(rc, spans.n);
+	if (spans.n)
+		memcpy(&rc->hl[j], spans.s, sizeof(struct hl_span) * spans.n);
+	rc->hl_gap += spans.n;
+	rc->hl_gap_l -= spans.n;
+	rc->hl_n += spans.n;
+
+	/* got to the end of the row, the rows after it have to be checked again if the state changed */
+	if (cv.at == -1 && syn->dfa.persist[st] != row->hl_open_comment) {
+		long idx = editor_row_idx(row);
+		row->hl_open_comment = syn->dfa.persist[st];
+		if (idx + 1 < g_e.hl_upto)
+			g_e.hl_upto = idx + 1;
 	}
 
-	/* set value of hl_open_comment to in_comment state */
-	int changed = (row->hl_open_comment != in_comment);
-	row->hl_open_comment = in_comment;
-	/* update syntax of all lines in case multiline comment */
-	if (changed && row->idx + 1 < g_e.n_rows)
-		editor_update_syntax(&g_e.row[row->idx + 1]);
+	return (1);
+}
+
+/* get the first span of a row that ends after render position at (binary search) */
+int editor_syntax_span(e_row *row, long at) {
+	struct row_rend *rc = row->rc;
+	int lo = 0;
+	int hi = rc->hl_n;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (HL_ST(rc, mid) + HL_SPAN(rc, mid).len <= at)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return (lo);
+}
+
+/*
+ * get hl class of a row at render position at and set end to the position
+ * where it changes, span is the first span that can be there (so a row is
+ * walked only once), the search match is drawn on top of the spans
+ */
+int editor_syntax_run(e_row *row, int *span, long at, long *end) {
+	struct row_rend *rc = row->rc;
+	int hl = HL_NORMAL;
+
+	/* skip spans before the position */
+	while (*span < rc->hl_n && HL_ST(rc, *span) + HL_SPAN(rc, *span).len <= at)
+		(*span)++;
+
+	/* in a span or before one */
+	*end = LONG_MAX;
+	if (*span < rc->hl_n) {
+		long st = HL_ST(rc, *span);
+		if (st <= at) {
+			hl = HL_SPAN(rc, *span).hl;
+			*end = st + HL_SPAN(rc, *span).len;
+		} else {
+			*end = st;
+		}
+	}
+
+	/* search match */
+	if (g_e.match_row == row) {
+		long m_end = g_e.match_rx + g_e.match_len;
+		if (at >= g_e.match_rx && at < m_end) {
+			hl = HL_MATCH;
+			*end = m_end;
+		} else if (at < g_e.match_rx && *end > g_e.match_rx) {
+			*end = g_e.match_rx;
+		}
+	}
+
+	return (hl);
 }
 
 /* handle colors */
@@ -214,30 +565,13 @@ void editor_select_syntax_hl() {
 	/* return if there is no file name yet */
 	if (g_e.filename == NULL) return;
 
-	/* get last '.' in string */
-	char *ext = strrchr(g_e.filename, '.');
-
-	/* loop editor syntax struct in the HLDB array */
-	for (unsigned int i = 0; i < HLDB_ENTRIES; i++) {
-		struct e_syntax *s = &HLDB[i];
-		unsigned int j = 0;
-		/* loop every pattern */
-		while (s->f_match[j]) {
-			int is_ext = (s->f_match[j][0] == '.');
-			/* check if match pattern */
-			if ((is_ext && ext && !strcmp(ext, s->f_match[j])) || (!is_ext && strstr(g_e.filename, s->f_match[j]))) {
-				/* set syntax */
-				g_e.syntax = s;
-
-				/* update syntax */
-				int f_row;
-				for (f_row = 0; f_row < g_e.n_rows; f_row++) {
-					editor_update_syntax(&g_e.row[f_row]);
-				}
+	/* get syntax of the file */
+	g_e.syntax = syntax_db_match(g_e.filename);
+	if (g_e.syntax == NULL) return;
 
-				return;
-			}
-			j++;
-		}
-	}
+	/* update syntax (new generation, hl of all the rows is built again when needed) */
+	rcache_drop_hl();
+	g_e.hl_gen++;
+	g_e.hl_upto = 0;
+	g_e.hl_stamp++;
 }
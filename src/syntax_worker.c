@@ -0,0 +1,293 @@
+#include <minivim.h>
+
+/*
+ * the multiline comment state of the rows after the watermark is found by a
+ * worker thread, the UI thread copies the lines of a slice of rows (a
+ * snapshot, the worker never touches the rows) with their checkpoints, the
+ * worker lexes them until the state converges and the UI thread publishes the
+ * new checkpoints if the buffer did not change in the meantime (hl_stamp)
+ *
+ * rows on the screen are lexed by the UI thread as soon as the state at their
+ * start is known, so the screen is drawn again when the watermark gets to it
+ */
+
+/* job states */
+# define HL_JOB_IDLE 0
+# define HL_JOB_QUEUED 1
+# define HL_JOB_DONE 2
+
+/* slice of rows to lex */
+struct hl_job {
+	int state;
+	/* syntax, generation and buffer stamp of the snapshot */
+	struct e_syntax *syn;
+	int gen;
+	unsigned int stamp;
+	/* index of the first row, number of rows and state at the start */
+	long idx;
+	int n;
+	int in;
+	/* lines of the rows (copied, len is -1 if the row is too long to be highlighted) */
+	char *buff;
+	size_t buff_sz;
+	size_t *off;
+	long *len;
+	/* start state of the checkpoint of the rows (-1 if not valid) and state at their start and end after lexing */
+	int *ck_in;
+	int *in_st;
+	int *out_st;
+	int cap;
+	/* rows lexed */
+	int done;
+};
+
+static struct hl_job hl_job = {0};
+
+# if HL_THREAD
+static pthread_t hl_thread;
+static pthread_mutex_t hl_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hl_cond = PTHREAD_COND_INITIALIZER;
+/* eventfd (linux) or pipe the worker notifies when a job is done */
+static int hl_pipe[2] = {-1, -1};
+# endif
+
+/* lex the rows of a job until the state converges (worker side, only uses the job) */
+static void hl_job_run(struct hl_job *job) {
+	int in = job->in;
+	int i;
+
+	for (i = 0; i < job->n; i++) {
+		/* checkpoint of the row is right, the rest of the rows are too */
+		if (job->ck_in[i] == in)
+			break;
+
+		/* lex line (tabs do not change the state, no need for the spans), too long rows do not change it */
+		job->in_st[i] = in;
+		if (job->len[i] != -1)
+			in = editor_syntax_lex(job->syn, &job->buff[job->off[i]], job->len[i], NULL, in);
+		job->out_st[i] = in;
+	}
+
+	job->done = i;
+}
+
+/* grow the per row arrays of a job */
+static void hl_job_grow(struct hl_job *job, int n) {
+	if (n <= job->cap)
+		return;
+
+	job->cap = n;
+	job->off = (size_t *)realloc(job->off, sizeof(size_t) * n);
+	job->len = (long *)realloc(job->len, sizeof(long) * n);
+	job->ck_in = (int *)realloc(job->ck_in, sizeof(int) * n);
+	job->in_st = (int *)realloc(job->in_st, sizeof(int) * n);
+	job->out_st = (int *)realloc(job->out_st, sizeof(int) * n);
+	if (!job->off || !job->len || !job->ck_in || !job->in_st || !job->out_st)
+		die("realloc");
+}
+
+/* take a snapshot of the next slice of rows to lex, return 0 if there is nothing to lex */
+static int hl_job_prep(struct hl_job *job) {
+	size_t b_len = 0;
+	int skip = 0;
+	int in = 0;
+	e_row *row;
+
+	/* nothing to lex */
+	if (g_e.syntax == NULL || g_e.hl_upto >= g_e.n_rows)
+		return (0);
+
+	/* get state at the end of the last known row */
+	row = editor_row_at(g_e.hl_upto);
+	if (g_e.hl_upto > 0)
+		in = editor_row_prev(row)->hl_open_comment;
+
+	/* move the watermark over the rows that converged (no need to copy them) */
+	while (row && row->hl_gen == g_e.hl_gen && row->hl_in == in && skip < HL_SKIP) {
+		in = row->hl_open_comment;
+		row = editor_row_next(row);
+		g_e.hl_upto++;
+		skip++;
+	}
+	if (!row)
+		return (0);
+
+	job->syn = g_e.syntax;
+	job->gen = g_e.hl_gen;
+	job->stamp = g_e.hl_stamp;
+	job->idx = g_e.hl_upto;
+	job->in = in;
+
+	/* copy rows until the slice is full */
+	for (job->n = 0; row && job->n < HL_SLICE && b_len < HL_JOB_BYTES; row = editor_row_next(row), job->n++) {
+		hl_job_grow(job, job->n + 1);
+		job->off[job->n] = b_len;
+		job->ck_in[job->n] = (row->hl_gen == g_e.hl_gen) ? row->hl_in : -1;
+		if (HL_PLAIN(row->sz)) {
+			job->len[job->n] = -1;
+			continue;
+		}
+		if (b_len + row->sz > job->buff_sz) {
+			job->buff_sz = (b_len + row->sz) * 2;
+			job->buff = (char *)realloc(job->buff, job->buff_sz);
+			if (!job->buff)
+				die("realloc");
+		}
+		/* the row being edited has a gap in its line */
+		if (row->gap_l) {
+			memcpy(&job->buff[b_len], row->line, row->gap);
+			memcpy(&job->buff[b_len + row->gap], &row->line[row->gap + row->gap_l], row->sz - row->gap);
+		} else {
+			memcpy(&job->buff[b_len], row->line, row->sz);
+		}
+		job->len[job->n] = row->sz;
+		b_len += row->sz;
+	}
+
+	return (1);
+}
+
+/* publish the states found by a job, return 0 if the buffer changed (snapshot is old) */
+static int hl_job_publish(struct hl_job *job) {
+	e_row *row;
+	long i;
+
+	/* snapshot is old, the rows changed */
+	if (job->stamp != g_e.hl_stamp || job->gen != g_e.hl_gen || job->syn != g_e.syntax)
+		return (0);
+
+	/* skip the rows the UI thread lexed in the meantime */
+	i = g_e.hl_upto - job->idx;
+	if (i < 0)
+		return (0);
+
+	row = editor_row_at(g_e.hl_upto);
+	for (; i < job->done && row; i++, row = editor_row_next(row)) {
+		/* new checkpoint, hl of the row (if any) is not right anymore */
+		if (row->hl_gen != job->gen || row->hl_in != job->in_st[i] || row->hl_open_comment != job->out_st[i]) {
+			rcache_drop(row);
+			row->hl_in = job->in_st[i];
+			row->hl_open_comment = job->out_st[i];
+			row->hl_gen = job->gen;
+		}
+		g_e.hl_upto++;
+	}
+
+	return (1);
+}
+
+# if HL_THREAD
+/* worker thread, lex the jobs that are queued */
+static void *hl_worker(void *arg) {
+	(void)arg;
+
+	pthread_mutex_lock(&hl_mtx);
+	while (1) {
+		while (hl_job.state != HL_JOB_QUEUED)
+			pthread_cond_wait(&hl_cond, &hl_mtx);
+		pthread_mutex_unlock(&hl_mtx);
+
+		hl_job_run(&hl_job);
+
+		/* tell the UI thread the job is done */
+		pthread_mutex_lock(&hl_mtx);
+		hl_job.state = HL_JOB_DONE;
+# ifdef __linux__
+		uint64_t one = 1;
+		if (write(hl_pipe[1], &one, sizeof(one)) == -1 && errno != EAGAIN)
+			die("write");
+# else
+		if (write(hl_pipe[1], "", 1) == -1 && errno != EAGAIN)
+			die("write");
+# endif
+	}
+
+	return (NULL);
+}
+
+/* start the worker thread (first time there is syntax work) */
+static void hl_worker_start() {
+	if (hl_pipe[0] != -1)
+		return;
+
+# ifdef __linux__
+	/* one counter for both ends */
+	hl_pipe[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (hl_pipe[0] == -1)
+		die("eventfd");
+	hl_pipe[1] = hl_pipe[0];
+# else
+	if (pipe(hl_pipe) == -1)
+		die("pipe");
+	fcntl(hl_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(hl_pipe[1], F_SETFL, O_NONBLOCK);
+# endif
+	if (pthread_create(&hl_thread, NULL, hl_worker, NULL) != 0)
+		die("pthread_create");
+	g_e.hl_fd = hl_pipe[0];
+}
+# endif
+
+/*
+ * do syntax work between keystrokes: publish the job the worker finished and
+ * queue the next one, set redraw if the screen has to be drawn again, return
+ * true if there is a job in progress
+ */
+int editor_syntax_idle(int *redraw) {
+	int state;
+	int busy = 0;
+	long upto = g_e.hl_upto;
+
+	*redraw = 0;
+
+# if HL_THREAD
+	pthread_mutex_lock(&hl_mtx);
+	state = hl_job.state;
+	pthread_mutex_unlock(&hl_mtx);
+# else
+	state = hl_job.state;
+# endif
+
+	/* worker is still on it */
+	if (state == HL_JOB_QUEUED)
+		return (1);
+
+	/* publish finished job */
+	if (state == HL_JOB_DONE) {
+# if HL_THREAD
+# ifdef __linux__
+		uint64_t cnt;
+		if (read(hl_pipe[0], &cnt, sizeof(cnt)) == -1 && errno != EAGAIN)
+			die("read");
+# else
+		char c;
+		while (read(hl_pipe[0], &c, 1) == 1)
+			;
+# endif
+# endif
+		hl_job_publish(&hl_job);
+		hl_job.state = HL_JOB_IDLE;
+	}
+
+	/* queue next job */
+	if (hl_job_prep(&hl_job)) {
+# if HL_THREAD
+		hl_worker_start();
+		pthread_mutex_lock(&hl_mtx);
+		hl_job.state = HL_JOB_QUEUED;
+		pthread_cond_signal(&hl_cond);
+		pthread_mutex_unlock(&hl_mtx);
+# else
+		/* no threads, lex the slice right now */
+		hl_job_run(&hl_job);
+		hl_job.state = HL_JOB_DONE;
+# endif
+		busy = 1;
+	}
+
+	/* state of the first row on the screen is known now, draw it with hl */
+	if (upto < g_e.y_off + g_e.scrn_rows && g_e.hl_upto >= g_e.y_off && g_e.hl_upto > upto)
+		*redraw = 1;
+
+	return (busy);
+}
@@ -16,6 +16,8 @@ void die(const char *s) {
 
 /* atexit(), end ncurses, disable raw mode on terminal and restore origin attributes */
 void dis_raw_mode() {
+	/* disable bracketed paste */
+	write(STDOUT_FILENO, "\x1b[?2004l", 8);
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_e.org_termios) == -1)
 		die("tcsetattr");
 }
@@ -37,45 +39,298 @@ void enb_raw_mode() {
 	raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
 	raw.c_cflag &= ~(CSIZE | PARENB);
 	raw.c_cflag |= ~(CS8);
-	/* timeout */
-	raw.c_cc[VMIN] = 0;
-	raw.c_cc[VTIME] = 1;
+	/* reads wait for a byte (stdin is only read when poll says there is input, no VTIME wake ups) */
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
 	/* apply changes to terminal */
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
 		die("tcsetattr");
+
+	/* enable bracketed paste (pasted text comes between "\x1b[200~" and "\x1b[201~") */
+	write(STDOUT_FILENO, "\x1b[?2004h", 8);
+}
+
+/*
+ * frames are written to a non blocking descriptor of the terminal, when the
+ * terminal does not take the whole frame the rest is written while waiting
+ * for keys and the frames drawn in the meantime are dropped (the next one is
+ * drawn from the last state when the terminal took the old one)
+ */
+
+/* open the terminal for output (its own file description, so only output is non blocking) */
+int editor_output_open() {
+	char *tty = ttyname(STDOUT_FILENO);
+	int fd = -1;
+
+	if (tty)
+		fd = open(tty, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+	/* not a terminal, just block */
+	return ((fd == -1) ? STDOUT_FILENO : fd);
+}
+
+/* write what the terminal takes of the frame, return true if part of it is still pending */
+int editor_output_flush() {
+	while (g_e.frame_off < g_e.frame.len) {
+		ssize_t n = write(g_e.out_fd, &g_e.frame.buff[g_e.frame_off], g_e.frame.len - g_e.frame_off);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return (1);
+			die("write");
+		}
+		g_e.frame_off += n;
+	}
+
+	return (0);
+}
+
+/* write the whole frame (before writing to the terminal directly) */
+void editor_output_drain() {
+	struct pollfd pfd = {g_e.out_fd, POLLOUT, 0};
+
+	while (editor_output_flush())
+		poll(&pfd, 1, -1);
+}
+
+/*
+ * the editor waits for events in a single poll: keys, the resize signal
+ * (through a self pipe), the syntax worker and the terminal taking the frame,
+ * so it sleeps until one of them happens and draws the screen right after a
+ * resize or when the worker gets the hl of the rows on the screen
+ */
+
+/* self pipe written by the SIGWINCH handler */
+static int winch_pipe[2] = {-1, -1};
+
+/* SIGWINCH handler, wake up the event loop */
+static void editor_sigwinch(int sig) {
+	int err = errno;
+	ssize_t n;
+
+	/* pipe full means a resize is already pending */
+	(void)sig;
+	n = write(winch_pipe[1], "", 1);
+	(void)n;
+	errno = err;
+}
+
+/* set up the event sources (resize signal) */
+void editor_events_init() {
+	struct sigaction sa;
+	int i;
+
+	if (pipe(winch_pipe) == -1)
+		die("pipe");
+	for (i = 0; i < 2; i++) {
+		fcntl(winch_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(winch_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = editor_sigwinch;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGWINCH, &sa, NULL) == -1)
+		die("sigaction");
+}
+
+/* terminal was resized, get the new size (the screen is drawn again from scratch) */
+static void editor_resize() {
+	struct winsize ws;
+	char c;
+
+	while (read(winch_pipe[0], &c, 1) == 1)
+		;
+
+	/* ioctl only (asking the terminal for the cursor position would read the typed-ahead keys), keep the size if it fails */
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+		return;
+	/* remove status bar and msg bar (keep a row to edit) */
+	g_e.scrn_rows = (ws.ws_row > 3) ? ws.ws_row - 2 : 1;
+	g_e.scrn_cols = (ws.ws_col > 1) ? ws.ws_col : 1;
+	editor_invalidate_screen();
+	g_e.redraw = 1;
+}
+
+/* get time in ms (only to measure waits) */
+static long editor_now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000L + ts.tv_nsec / 1000000);
+}
+
+/*
+ * wait up to ms (-1: no limit) for a key, doing syntax work, writing the frame
+ * and handling resizes meanwhile (draw again if needed), return false if no
+ * key came in time
+ */
+static int editor_wait_key(int ms) {
+	struct pollfd pfd[4] = {{STDIN_FILENO, POLLIN, 0}, {-1, POLLIN, 0}, {-1, POLLIN, 0}, {-1, POLLOUT, 0}};
+	long until = (ms < 0) ? -1 : editor_now_ms() + ms;
+	int redraw;
+	int wait;
+
+	while (1) {
+		int busy = editor_syntax_idle(&redraw);
+		int pending = editor_output_flush();
+
+		/* draw when the screen gets its hl or the frame that was dropped (once the terminal took the last one) */
+		if (redraw)
+			g_e.redraw = 1;
+		if (g_e.redraw && !pending) {
+			editor_refresh_screen();
+			pending = editor_output_flush();
+		}
+
+		/* wait for a key, a resize, the worker (do not wait without it) or the terminal */
+		pfd[1].fd = winch_pipe[0];
+		pfd[2].fd = busy ? g_e.hl_fd : -1;
+		pfd[3].fd = pending ? g_e.out_fd : -1;
+		wait = (until == -1) ? -1 : (int)(until - editor_now_ms());
+		if ((until != -1 && wait < 0) || (busy && g_e.hl_fd < 0))
+			wait = 0;
+		if (poll(pfd, 4, wait) == -1) {
+			if (errno == EINTR)
+				continue;
+			die("poll");
+		}
+		if (pfd[1].revents & POLLIN)
+			editor_resize();
+		if (pfd[0].revents & (POLLIN | POLLHUP))
+			return (1);
+		if (until != -1 && editor_now_ms() >= until)
+			return (0);
+	}
+}
+
+/*
+ * input is read in chunks into a ring buffer, so keys typed ahead (or pasted)
+ * cost one read for many keys and the main loop can tell there are more keys
+ * waiting (and not draw the screen until they are processed)
+ */
+
+/* size of the input ring buffer (power of 2) */
+# define INPUT_BUFF (1 << 16)
+
+static struct {
+	char buff[INPUT_BUFF];
+	/* position of the next byte and bytes in the buffer */
+	size_t st;
+	size_t len;
+	/* stdin was closed (no more input will come) */
+	int eof;
+} g_in = {{0}, 0, 0, 0};
+
+/* max wait for the rest of an escape sequence (ms) */
+# define ESC_TIMEOUT 100
+
+/* max wait for more of a paste, the end of the paste never came (ms) */
+# define PASTE_TIMEOUT 1000
+
+/* wait up to ms (-1: no limit) for input, return true if there is some */
+static int input_wait(int ms) {
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+	int n;
+
+	while ((n = poll(&pfd, 1, ms)) == -1 && errno == EINTR)
+		;
+
+	return (n == 1);
+}
+
+/* read what stdin has into the ring buffer (only called when there is input), return bytes read */
+static ssize_t input_fill() {
+	size_t end = (g_in.st + g_in.len) & (INPUT_BUFF - 1);
+	size_t room = INPUT_BUFF - g_in.len;
+	ssize_t n;
+
+	/* free space until the end of the buffer (the rest is used in the next read) */
+	if (end + room > INPUT_BUFF)
+		room = INPUT_BUFF - end;
+	if (!room)
+		return (0);
+
+	n = read(STDIN_FILENO, &g_in.buff[end], room);
+	if (n == -1 && errno != EAGAIN && errno != EINTR)
+		die("read");
+	if (n == 0)
+		g_in.eof = 1;
+	if (n > 0)
+		g_in.len += n;
+
+	return (n);
+}
+
+/* get next input byte, return 0 if there is none (after waiting up to ms) */
+static int input_byte(char *c, int ms) {
+	if (!g_in.len && (!input_wait(ms) || input_fill() <= 0))
+		return (0);
+
+	*c = g_in.buff[g_in.st];
+	g_in.st = (g_in.st + 1) & (INPUT_BUFF - 1);
+	g_in.len--;
+
+	return (1);
+}
+
+/* return true if there are keys waiting to be processed */
+int editor_input_pending() {
+	struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+
+	if (g_in.len)
+		return (1);
+
+	return (poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN));
 }
 
 /* read key */
 int editor_read_key() {
-	int nread;
 	char c;
 
-	/* read 1 byte */
-	while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-		if (nread == -1 && errno != EAGAIN)
+	/* read 1 byte (wait for it if there is nothing in the buffer) */
+	while (1) {
+		if (!g_in.len)
+			editor_wait_key(-1);
+		if (input_byte(&c, 0))
+			break;
+		/* no key will ever come (as a read of a terminal that hung up) */
+		if (g_in.eof) {
+			errno = EIO;
 			die("read");
+		}
 	}
 
 	/* keep reading if escape char is read */
 	if (c == '\x1b') {
-		char seq[3];
+		char seq[2];
 
 		/* read the rest of the sequence */
-		if (read(STDIN_FILENO, &seq[0], 1) != 1) return ('\x1b');
-		if (read(STDIN_FILENO, &seq[1], 1) != 1) return ('\x1b');
+		if (!input_byte(&seq[0], ESC_TIMEOUT)) return ('\x1b');
+		if (!input_byte(&seq[1], ESC_TIMEOUT)) return ('\x1b');
 
 		/* get arrows */
 		if (seq[0] == '[') {
 			if (seq[1] >= '0' && seq[1] <= '9') {
-				if (read(STDIN_FILENO, &seq[2], 1) != 1) return ('\x1b');
-				if (seq[2] == '~') {
-					if (seq[1] == '1') return (K_HOME);
-					if (seq[1] == '3') return (K_DEL);
-					if (seq[1] == '4') return (K_END);
-					if (seq[1] == '5') return (K_PAGE_UP);
-					if (seq[1] == '6') return (K_PAGE_DOWN);
-					if (seq[1] == '7') return (K_HOME);
-					if (seq[1] == '8') return (K_END);
+				/* number until '~' */
+				int n = seq[1] - '0';
+				char d;
+				while (1) {
+					if (!input_byte(&d, ESC_TIMEOUT)) return ('\x1b');
+					if (d < '0' || d > '9') break;
+					n = n * 10 + d - '0';
+				}
+				if (d == '~') {
+					if (n == 1) return (K_HOME);
+					if (n == 3) return (K_DEL);
+					if (n == 4) return (K_END);
+					if (n == 5) return (K_PAGE_UP);
+					if (n == 6) return (K_PAGE_DOWN);
+					if (n == 7) return (K_HOME);
+					if (n == 8) return (K_END);
+					if (n == 200) return (K_PASTE);
 				}
 			}
 			if (seq[1] == 'A') return (K_ARROW_UP);
@@ -95,6 +350,41 @@ int editor_read_key() {
 	return (c);
 }
 
+/* read the text of a bracketed paste (after K_PASTE) until its end, return it (len is set, what came if the end did not) */
+char *editor_read_paste(size_t *len) {
+	const char *end = "\x1b[201~";
+	size_t cap = 4096;
+	char *buff = (char *)malloc(cap);
+	char c;
+
+	if (!buff)
+		die("malloc");
+
+	*len = 0;
+	while (1) {
+		/* wait for the rest of the paste (stop if it does not come or stdin is closed) */
+		if (!g_in.len && !editor_wait_key(PASTE_TIMEOUT))
+			return (buff);
+		if (!input_byte(&c, 0)) {
+			if (g_in.eof)
+				return (buff);
+			continue;
+		}
+		if (*len == cap) {
+			cap *= 2;
+			buff = (char *)realloc(buff, cap);
+			if (!buff)
+				die("realloc");
+		}
+		buff[(*len)++] = c;
+		/* end of the paste */
+		if (*len >= 6 && c == '~' && !memcmp(&buff[*len - 6], end, 6)) {
+			*len -= 6;
+			return (buff);
+		}
+	}
+}
+
 /* get cursor pos on terminal */
 int get_cursor_pos(int *rows, int *cols) {
 	char buff[32];
@@ -110,7 +400,7 @@ int get_cursor_pos(int *rows, int *cols) {
 	/* buff will be something like "<esc>30;120" (30 is the number of rows, and 120 of cols) */
 	i = -1;
 	while (++i < sizeof(buff) - 1) {
-		if (read(STDIN_FILENO, &buff[i], 1) != 1)
+		if (!input_wait(ESC_TIMEOUT) || read(STDIN_FILENO, &buff[i], 1) != 1)
 			break;
 		if (buff[i] == 'R')
 			break;